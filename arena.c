@@ -0,0 +1,151 @@
+#include "arena.h"
+#include "chess.h"
+#include "nn.h"
+#include <assert.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+static double arena_score_of(double elo) {
+    return(1 / (1 + pow(10, -elo / 400)));
+}
+static double arena_elo_of(double score) {
+    // Clamped so that a perfect score gives a big but finite number
+    score = score < 1e-6 ? 1e-6 : (score > 1 - 1e-6 ? 1 - 1e-6 : score);
+    return(-400 * log10(1 / score - 1));
+}
+arena_result_t arena_result(arena_t *arena) {
+    /*
+     * The log likelihood ratio is the usual normal approximation of the generalized SPRT, LLR = N (s1 - s0) (2s - s0 - s1) / (2 var),
+     * with s the mean score per game, var its variance per game and s0, s1 the expected scores under both hypotheses
+     */
+    arena_result_t result = {0};
+    result.wins = atomic_load(&arena->wins);
+    result.draws = atomic_load(&arena->draws);
+    result.losses = atomic_load(&arena->losses);
+    result.lower = log(arena->sprt.beta / (1 - arena->sprt.alpha));
+    result.upper = log((1 - arena->sprt.beta) / arena->sprt.alpha);
+    double n = result.wins + result.draws + result.losses;
+    if(n == 0) {
+        return(result);
+    }
+    double s = (result.wins + 0.5 * result.draws) / n;
+    double var = (result.wins * (1 - s) * (1 - s) + result.draws * (0.5 - s) * (0.5 - s) + result.losses * s * s) / n;
+    result.elo = arena_elo_of(s);
+    result.elo_error = (arena_elo_of(s + 1.96 * sqrt(var / n)) - arena_elo_of(s - 1.96 * sqrt(var / n))) / 2;
+    if(var > 0) {
+        double s0 = arena_score_of(arena->sprt.elo0);
+        double s1 = arena_score_of(arena->sprt.elo1);
+        result.llr = n * (s1 - s0) * (2 * s - s0 - s1) / (2 * var);
+    }
+    result.decision = result.llr >= result.upper ? 1 : (result.llr <= result.lower ? -1 : 0);
+    return(result);
+}
+void arena_opening(board_t *board, move_t *temp, uint64_t *rng) {
+    // ARENA_OPENING_PLIES random plies from the start position, repeated until they leave a position where the game is still going
+    for(;;) {
+        chess_board_read_fen(board, CHESS_STARTPOS);
+        int64_t ply = 0;
+        for(; ply < ARENA_OPENING_PLIES; ply++) {
+            if(chess_board_random_move(board, temp, rng) != c_e) {
+                break;
+            }
+        }
+        if(ply == ARENA_OPENING_PLIES) {
+            return;
+        }
+    }
+}
+static void arena_count(arena_t *arena, enum color result, enum color candidate) {
+    if(result == c_d) {
+        atomic_fetch_add(&arena->draws, 1);
+    } else if(result == candidate) {
+        atomic_fetch_add(&arena->wins, 1);
+    } else {
+        atomic_fetch_add(&arena->losses, 1);
+    }
+}
+static void *arena_thread(void *argument) {
+    /*
+     * Every pair plays one opening twice with the colors swapped, which cancels most of the luck of the opening.
+     * The opening of a pair only depends on the seed and the pair index, so a match is reproducible whatever the amount of threads
+     */
+    arena_worker_t *worker = argument;
+    arena_t *arena = worker->arena;
+    board_t opening = chess_board_alloc();
+    while(!atomic_load(&arena->stop)) {
+        int64_t pair = atomic_fetch_add(&arena->next_pair, 1);
+        if(pair >= arena->pairs) {
+            break;
+        }
+        uint64_t rng = (arena->seed + pair + 1) * 0x9E3779B97F4A7C15ULL;
+        arena_opening(&worker->board, worker->temp, &rng);
+        chess_board_copy(&opening, &worker->board);
+        arena_count(arena, chess_play_ai_game(&worker->board, &worker->candidate, &worker->baseline, worker->temp), c_w);
+        chess_board_copy(&worker->board, &opening);
+        arena_count(arena, chess_play_ai_game(&worker->board, &worker->baseline, &worker->candidate, worker->temp), c_b);
+        if(arena_result(arena).decision != 0) {
+            atomic_store(&arena->stop, true);
+        }
+    }
+    free(opening.square);
+    free(opening.movelist);
+    return(NULL);
+}
+arena_t *arena_alloc(neuralnet_t candidate, neuralnet_t baseline, int64_t thread_count) {
+    /*
+     * Both nets are only read, every worker scores moves with batches of its own that share their weights
+     */
+    assert(thread_count > 0 && thread_count <= ARENA_THREADS_MAX);
+    arena_t *arena = calloc(1, sizeof(*arena));
+    assert(arena != NULL);
+    arena->thread_count = thread_count;
+    for(int64_t i = 0; i < thread_count; i++) {
+        arena->workers[i].arena = arena;
+        arena->workers[i].index = i;
+        arena->workers[i].board = chess_board_alloc();
+        arena->workers[i].candidate = neuralnet_batch(candidate, MAXM);
+        arena->workers[i].baseline = neuralnet_batch(baseline, MAXM);
+    }
+    return(arena);
+}
+void arena_free(arena_t *arena) {
+    for(int64_t i = 0; i < arena->thread_count; i++) {
+        free(arena->workers[i].board.square);
+        free(arena->workers[i].board.movelist);
+        neuralnet_batch_free(arena->workers[i].candidate);
+        neuralnet_batch_free(arena->workers[i].baseline);
+    }
+    free(arena);
+}
+arena_result_t arena_run(arena_t *arena, int64_t pairs, arena_sprt_t sprt, uint64_t seed) {
+    /*
+     * Plays up to pairs pairs of games on all threads and stops early as soon as the SPRT accepts one of the hypotheses.
+     * Games that were already running when it did are still counted
+     */
+    assert(pairs > 0);
+    assert(sprt.alpha > 0 && sprt.alpha < 1 && sprt.beta > 0 && sprt.beta < 1);
+    arena->pairs = pairs;
+    arena->seed = seed;
+    arena->sprt = sprt;
+    atomic_store(&arena->next_pair, 0);
+    atomic_store(&arena->wins, 0);
+    atomic_store(&arena->draws, 0);
+    atomic_store(&arena->losses, 0);
+    atomic_store(&arena->stop, false);
+    for(int64_t i = 1; i < arena->thread_count; i++) {
+        if(pthread_create(&arena->threads[i], NULL, arena_thread, &arena->workers[i]) != 0) {
+            fprintf(stderr, "ERROR: Could not start arena worker %ld\n", i);
+            exit(1);
+        }
+    }
+    arena_thread(&arena->workers[0]);
+    for(int64_t i = 1; i < arena->thread_count; i++) {
+        pthread_join(arena->threads[i], NULL);
+    }
+    return(arena_result(arena));
+}
@@ -0,0 +1,67 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include "chess.h"
+#include "nn.h"
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#define ARENA_THREADS_MAX 64
+#define ARENA_OPENING_PLIES 8 // Random plies from the start position before the nets take over, so that the pairs don't all play the same game
+
+typedef struct {
+    // The hypotheses in Elo of candidate over baseline and the error rates, H0 is elo0 and H1 is elo1
+    double elo0;
+    double elo1;
+    double alpha;
+    double beta;
+} arena_sprt_t;
+
+typedef struct {
+    // From the perspective of the candidate
+    int64_t wins;
+    int64_t draws;
+    int64_t losses;
+    double elo;
+    double elo_error; // Half width of the 95% confidence interval
+    double llr;
+    double lower; // The SPRT accepts H0 once llr drops below lower and H1 once it climbs above upper
+    double upper;
+    int64_t decision; // -1 for H0, 1 for H1, 0 if the match ran out of pairs first
+} arena_result_t;
+
+struct arena;
+
+typedef struct {
+    struct arena *arena;
+    int64_t index;
+    board_t board;
+    move_t temp[MAXM];
+    // Batches of both nets, every worker needs its own activations
+    neuralnet_t candidate;
+    neuralnet_t baseline;
+} arena_worker_t;
+
+typedef struct arena {
+    int64_t thread_count;
+    int64_t pairs;
+    uint64_t seed;
+    arena_sprt_t sprt;
+    arena_worker_t workers[ARENA_THREADS_MAX];
+    pthread_t threads[ARENA_THREADS_MAX];
+    atomic_int_fast64_t next_pair;
+    atomic_int_fast64_t wins;
+    atomic_int_fast64_t draws;
+    atomic_int_fast64_t losses;
+    atomic_bool stop;
+} arena_t;
+
+extern arena_t *arena_alloc(neuralnet_t candidate, neuralnet_t baseline, int64_t thread_count);
+extern void arena_free(arena_t *arena);
+extern arena_result_t arena_result(arena_t *arena);
+extern void arena_opening(board_t *board, move_t *temp, uint64_t *rng);
+extern arena_result_t arena_run(arena_t *arena, int64_t pairs, arena_sprt_t sprt, uint64_t seed);
+
+#endif
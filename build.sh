@@ -1,4 +1,4 @@
 #!/bin/sh
 set -xe
-time clang main.c chess.c nn.c -ggdb -o blade -mavx2 -O3 -Wall -Wpedantic -Wextra -lm
+time clang main.c chess.c nn.c uci.c mcts.c tree.c kernels.c train.c team.c optim.c loader.c arena.c evolve.c quant.c -ggdb -o blade -O3 -Wall -Wpedantic -Wextra -lm -lpthread
 ./blade > out.txt
@@ -2,11 +2,13 @@
 #include "nn.h"
 #include <assert.h>
 #include <math.h>
+#include <pthread.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <stddef.h>
 #include <stdint.h>
+#include <string.h>
 
 // Just comment out the macros you don't want
 
@@ -22,6 +24,51 @@ int64_t chess_rank_of(int64_t square) {
 int64_t chess_file_of(int64_t square) {
     return(square % 8);
 }
+// Geometry tables, filled once by chess_tables_init() so the move generator and check detection only ever do table loads
+uint64_t chess_knight_attacks[BOARDTOP];
+uint64_t chess_king_attacks[BOARDTOP];
+uint64_t chess_pawn_attacks[2][BOARDTOP];
+uint8_t chess_ray_length[BOARDTOP][8];
+// Diagonal directions come first and rook directions last, and dir ^ 1 is always the opposite direction
+const int64_t chess_direction_offset[8] = {9, -9, 7, -7, 8, -8, 1, -1};
+static const int64_t chess_direction_file[8] = {1, -1, -1, 1, 0, 0, 1, -1};
+static const int64_t chess_direction_rank[8] = {1, -1, 1, -1, 1, -1, 0, 0};
+
+static uint64_t chess_tables_step(int64_t sq, int64_t file_step, int64_t rank_step) {
+    int64_t f = chess_file_of(sq) + file_step;
+    int64_t r = chess_rank_of(sq) + rank_step;
+    if(f < f_a || f > f_h || r < r_1 || r > r_8) {
+        return(0);
+    }
+    return(CHESS_BIT(r * 8 + f));
+}
+static void chess_tables_init_once(void) {
+    const int64_t knight_steps[8][2] = {{1, 2}, {2, 1}, {2, -1}, {1, -2}, {-1, -2}, {-2, -1}, {-2, 1}, {-1, 2}};
+    for(int64_t sq = 0; sq < BOARDTOP; sq++) {
+        chess_knight_attacks[sq] = 0;
+        chess_king_attacks[sq] = 0;
+        for(int64_t i = 0; i < 8; i++) {
+            chess_knight_attacks[sq] |= chess_tables_step(sq, knight_steps[i][0], knight_steps[i][1]);
+            chess_king_attacks[sq] |= chess_tables_step(sq, chess_direction_file[i], chess_direction_rank[i]);
+        }
+        chess_pawn_attacks[CHESS_COLOR_INDEX(c_w)][sq] = chess_tables_step(sq, -1, 1) | chess_tables_step(sq, 1, 1);
+        chess_pawn_attacks[CHESS_COLOR_INDEX(c_b)][sq] = chess_tables_step(sq, -1, -1) | chess_tables_step(sq, 1, -1);
+        for(int64_t dir = 0; dir < 8; dir++) {
+            int64_t len = 0;
+            int64_t to = sq;
+            while(chess_tables_step(to, chess_direction_file[dir], chess_direction_rank[dir])) {
+                to += chess_direction_offset[dir];
+                len++;
+            }
+            chess_ray_length[sq][dir] = len;
+        }
+    }
+}
+void chess_tables_init(void) {
+    // Boards get allocated from several threads at once, e.g. by the arena workers, pthread_once keeps them from racing on the tables
+    static pthread_once_t once = PTHREAD_ONCE_INIT;
+    pthread_once(&once, chess_tables_init_once);
+}
 int64_t chess_piece_value(const char c) {
     switch(c) {
         case 'k':
@@ -134,6 +181,17 @@ bool chess_move_is_empty(move_t *move) {
     if(move->is_castle          != noc)   {return(false);}
     return(true);
 }
+void chess_move_name(move_t move, char name[6]) {
+    // Long algebraic notation as used by UCI, e.g. e2e4 or a7a8q
+    const char promotion_names[] = "_pnbrqk";
+    chess_name_of(move.from_square, name);
+    chess_name_of(move.to_square, name + 2);
+    name[4] = '\0';
+    if(move.promoted_piece != no) {
+        name[4] = promotion_names[move.promoted_piece < no ? -move.promoted_piece : move.promoted_piece];
+        name[5] = '\0';
+    }
+}
 void chess_move_reset(move_t *move) {
     move->from_square        = NOSQ;
     move->to_square          = NOSQ;
@@ -173,6 +231,7 @@ void chess_movelist_dump(move_t *movelist) {
 }
 board_t chess_board_alloc(void) {
     board_t board;
+    chess_tables_init();
     board.square = malloc(sizeof(*board.square) *(int64_t)BOARDTOP);
     board.movelist = malloc(sizeof(*board.movelist) * MAXM);
 
@@ -188,6 +247,7 @@ board_t chess_board_alloc(void) {
     board.fifty_move    = 0;
     board.past_moves    = 0;
     board.castle_perm    = 0;
+    board.accumulator    = NULL;
     return(board);
 }
 void chess_board_read_fen(board_t *board, const char *fen) {
@@ -334,6 +394,9 @@ void chess_board_read_fen(board_t *board, const char *fen) {
                 board->castle_perm += 8;
                 break;
             }
+            case '-': {
+                break;
+            }
             default: {
                 fprintf(stderr, "ERROR: character %c is invalid. expected K,Q,k,q", *fen);
                 exit(1);
@@ -350,11 +413,15 @@ void chess_board_read_fen(board_t *board, const char *fen) {
             if(temp == 0) {
                 assert(*(fen + temp) >= 'a');
                 file = *(fen + temp) - 'a';
+#ifdef CHESS_BOARD_PRINT_DEBUG
                 printf("file: %ld\n", file);
+#endif
             } else if(temp == 1) {
                 assert(*(fen + temp) <= '8');
                 rank = *(fen + temp) - '1';
+#ifdef CHESS_BOARD_PRINT_DEBUG
                 printf("rank: %ld\n", rank);
+#endif
             } else {
                 fprintf(stderr, "ERROR: invalid en passant");
                 exit(1);
@@ -385,6 +452,17 @@ void chess_board_read_fen(board_t *board, const char *fen) {
         fen++;
     }
 }
+void chess_board_copy(board_t *destination, board_t *source) {
+    // The movelist is only scratch space for move generation so it is not copied
+    memcpy(destination->square, source->square, sizeof(*source->square) * BOARDTOP);
+    destination->stm           = source->stm;
+    destination->white_king_sq = source->white_king_sq;
+    destination->black_king_sq = source->black_king_sq;
+    destination->en_passant_sq = source->en_passant_sq;
+    destination->fifty_move    = source->fifty_move;
+    destination->past_moves    = source->past_moves;
+    destination->castle_perm   = source->castle_perm;
+}
 void chess_board_print(board_t board) {
     char name[3];
     const char piece_names[] = "kqrbnp_PNBRQK";
@@ -423,6 +501,14 @@ void chess_make_move(board_t *board, move_t *move) {
         fprintf(stderr, "ERROR: to_sq %lu\n", move->to_square);
         exit(1);
     }
+    if(board->accumulator != NULL) {
+        // Mirrors the square changes below: the moving piece leaves from, whatever was on to is captured and the moved or promoted piece appears on to
+        enum pieces moved = board->square[move->from_square];
+        enum pieces captured = board->square[move->to_square];
+        uint16_t added = CHESS_FEATURE(move->promoted_piece == no ? moved : move->promoted_piece, move->to_square);
+        uint16_t removed[2] = {CHESS_FEATURE(moved, move->from_square), CHESS_FEATURE(captured, move->to_square)};
+        accumulator_push(board->accumulator, &added, 1, removed, captured == no ? 1 : 2);
+    }
     if(board->square[move->from_square] == wk) {
         board->white_king_sq = move->to_square;
     }
@@ -449,6 +535,9 @@ void chess_undo_move(board_t *board, move_t *move) {
         printf("to_sq: %lu\n", move->to_square);
         exit(2);
     }
+    if(board->accumulator != NULL) {
+        accumulator_pop(board->accumulator);
+    }
     if(board->square[move->to_square] == wk) {
         board->white_king_sq = move->from_square;
     }
@@ -460,6 +549,7 @@ void chess_undo_move(board_t *board, move_t *move) {
         board->square[move->to_square] = move->captured_piece;
     } else {
         board->square[move->from_square] =(int64_t) board->stm; // Kind of hacky but it works cuz the pawn values are -1 and 1 which are also the values for the sides
+        board->square[move->to_square] = move->captured_piece;
     }
     board->castle_perm = move->past_castle_perm;
     board->fifty_move = move->past_fifty_move;
@@ -470,1632 +560,228 @@ void chess_undo_move(board_t *board, move_t *move) {
 //    chess_movelist_reset(movelist);
 //    int64_t sq = 0;
 //}
-void chess_board_pseudolegal_moves(board_t *board, move_t *movelist, enum color stm) {
-    // This does about ~3e6 per second
-    chess_movelist_reset(movelist);
+
+// The generator and the check detection are written once for a generic side `us` and instantiated for white and black by CHESS_INSTANTIATE_FOR_COLOR.
+// Because `us` is a compile time constant in every instance the piece codes, pawn directions and rank checks all fold into immediates
+// and the hot loop does not branch on the side to move anymore. Multiplying a piece by `us` makes our own pieces positive and the opponents negative.
+#define CHESS_ALWAYS_INLINE static inline __attribute__((always_inline))
+CHESS_ALWAYS_INLINE void chess_board_pseudolegal_moves_generic(board_t *board, move_t *movelist, const enum color us) {
+    const int64_t push = 8 * us;
+    const int64_t start_rank = us == c_w ? r_2 : r_7;
+    const int64_t promotion_rank = us == c_w ? r_7 : r_2;
+    const enum pieces promotions[4] = {wq, wn, wb, wr};
+    const int64_t king_castle = us == c_w ? wkc : bkc;
+    const int64_t queen_castle = us == c_w ? wqc : bqc;
     int64_t sq = 0;
     int64_t mi = 0;
-    int64_t off= 0;
-    int64_t dir= 0;
+    int64_t to = 0;
     int64_t t_cp = 0;
+    uint64_t targets = 0;
+    chess_movelist_reset(movelist);
     while(sq < NOSQ) {
-        int64_t piece = board->square[sq];
+        int64_t piece = board->square[sq] * us;
         switch(piece) {
-            case no: {
+            case bk: case bq: case br: case bb: case bn: case bp: case no: {
                 break;
             }
             case wp: {
-                if(stm == c_b) {
-                    break;
-                }
-                if(chess_rank_of(sq) < r_7) {
-                    if(board->square[sq + 8] == no) {
-                        t_cp = board->castle_perm;
-                        chess_move_set(&movelist[mi], sq, sq + 8, no, no, t_cp, board->castle_perm, NOSQ, board->en_passant_sq, false, 0, board->fifty_move, noc);
+                t_cp = board->castle_perm;
+                targets = chess_pawn_attacks[CHESS_COLOR_INDEX(us)][sq];
+                if(chess_rank_of(sq) != promotion_rank) {
+                    if(board->square[sq + push] == no) {
+                        chess_move_set(&movelist[mi], sq, sq + push, no, no, t_cp, board->castle_perm, NOSQ, board->en_passant_sq, false, 0, board->fifty_move, noc);
                         mi++;
-                        if(chess_rank_of(sq) == r_2 && board->square[sq + 16] == no) {
-                            t_cp = board->castle_perm;
-                            chess_move_set(&movelist[mi], sq, sq + 16, no, no, t_cp, board->castle_perm, sq + 8, board->en_passant_sq, false, 0, board->fifty_move, noc);
-                            mi++;
-                        }
-                    }
-                    if(chess_file_of(sq) != f_a) {
-                        if(board->square[sq + 7] < no) {
-                            t_cp = board->castle_perm;
-                            chess_move_set(&movelist[mi], sq, sq + 7, board->square[sq + 7], no, t_cp, board->castle_perm, NOSQ, board->en_passant_sq, false, 0, board->fifty_move, noc);
+                        if(chess_rank_of(sq) == start_rank && board->square[sq + 2 * push] == no) {
+                            chess_move_set(&movelist[mi], sq, sq + 2 * push, no, no, t_cp, board->castle_perm, sq + push, board->en_passant_sq, false, 0, board->fifty_move, noc);
                             mi++;
                         }
                     }
-                    if(chess_file_of(sq) != f_h) {
-                        if(board->square[sq + 9] < no) {
-                            t_cp = board->castle_perm;
-                            chess_move_set(&movelist[mi], sq, sq + 9, board->square[sq + 9], no, t_cp, board->castle_perm, NOSQ, board->en_passant_sq, false, 0, board->fifty_move, noc);
+                    while(targets) {
+                        to = chess_pop_lsb(&targets);
+                        if(board->square[to] * us < no) {
+                            chess_move_set(&movelist[mi], sq, to, board->square[to], no, t_cp, board->castle_perm, NOSQ, board->en_passant_sq, false, 0, board->fifty_move, noc);
                             mi++;
                         }
                     }
-                } else if(chess_rank_of(sq) == r_7) {
-                    if(board->square[sq + 8] == no) {
-                        t_cp = board->castle_perm;
-                        chess_move_set(&movelist[mi], sq, sq + 8, no, wq, t_cp, board->castle_perm, NOSQ, board->en_passant_sq, false, 0, board->fifty_move, noc);
-                        mi++;
-                        chess_move_set(&movelist[mi], sq, sq + 8, no, wn, t_cp, board->castle_perm, NOSQ, board->en_passant_sq, false, 0, board->fifty_move, noc);
-                        mi++;
-                        chess_move_set(&movelist[mi], sq, sq + 8, no, wb, t_cp, board->castle_perm, NOSQ, board->en_passant_sq, false, 0, board->fifty_move, noc);
-                        mi++;
-                        chess_move_set(&movelist[mi], sq, sq + 8, no, wr, t_cp, board->castle_perm, NOSQ, board->en_passant_sq, false, 0, board->fifty_move, noc);
-                        mi++;
-                    }
-                    if(chess_file_of(sq) != f_a) {
-                        if(board->square[sq + 7] < no) {
-                            t_cp = board->castle_perm;
-                            chess_move_set(&movelist[mi], sq, sq + 7, board->square[sq + 7], wq, t_cp, board->castle_perm, NOSQ, board->en_passant_sq, false, 0, board->fifty_move, noc);
-                            mi++;
-                            chess_move_set(&movelist[mi], sq, sq + 7, board->square[sq + 7], wn, t_cp, board->castle_perm, NOSQ, board->en_passant_sq, false, 0, board->fifty_move, noc);
-                            mi++;
-                            chess_move_set(&movelist[mi], sq, sq + 7, board->square[sq + 7], wb, t_cp, board->castle_perm, NOSQ, board->en_passant_sq, false, 0, board->fifty_move, noc);
-                            mi++;
-                            chess_move_set(&movelist[mi], sq, sq + 7, board->square[sq + 7], wr, t_cp, board->castle_perm, NOSQ, board->en_passant_sq, false, 0, board->fifty_move, noc);
+                } else {
+                    if(board->square[sq + push] == no) {
+                        for(int64_t i = 0; i < 4; i++) {
+                            chess_move_set(&movelist[mi], sq, sq + push, no, us * promotions[i], t_cp, board->castle_perm, NOSQ, board->en_passant_sq, false, 0, board->fifty_move, noc);
                             mi++;
                         }
                     }
-                    if(chess_file_of(sq) != f_h) {
-                        if(board->square[sq + 9] < no) {
-                            t_cp = board->castle_perm;
-                            chess_move_set(&movelist[mi], sq, sq + 9, board->square[sq + 9], wq, t_cp, board->castle_perm, NOSQ, board->en_passant_sq, false, 0, board->fifty_move, noc);
-                            mi++;
-                            chess_move_set(&movelist[mi], sq, sq + 9, board->square[sq + 9], wn, t_cp, board->castle_perm, NOSQ, board->en_passant_sq, false, 0, board->fifty_move, noc);
-                            mi++;
-                            chess_move_set(&movelist[mi], sq, sq + 9, board->square[sq + 9], wb, t_cp, board->castle_perm, NOSQ, board->en_passant_sq, false, 0, board->fifty_move, noc);
-                            mi++;
-                            chess_move_set(&movelist[mi], sq, sq + 9, board->square[sq + 9], wr, t_cp, board->castle_perm, NOSQ, board->en_passant_sq, false, 0, board->fifty_move, noc);
-                            mi++;
+                    while(targets) {
+                        to = chess_pop_lsb(&targets);
+                        if(board->square[to] * us < no) {
+                            for(int64_t i = 0; i < 4; i++) {
+                                chess_move_set(&movelist[mi], sq, to, board->square[to], us * promotions[i], t_cp, board->castle_perm, NOSQ, board->en_passant_sq, false, 0, board->fifty_move, noc);
+                                mi++;
+                            }
                         }
                     }
                 }
                 break;
             }
-            case bp: {
-                if(stm == c_w) {
-                    break;
+            case wn:
+            case wk: {
+                t_cp = board->castle_perm;
+                if(piece == wk) {
+                    BITOFF(t_cp, king_castle);
+                    BITOFF(t_cp, queen_castle);
+                    targets = chess_king_attacks[sq];
+                } else {
+                    targets = chess_knight_attacks[sq];
                 }
-                if(chess_rank_of(sq) > r_2) {
-                    if(board->square[sq - 8] == no) {
-                        t_cp = board->castle_perm;
-                        chess_move_set(&movelist[mi], sq, sq - 8, no, no, t_cp, board->castle_perm, NOSQ, board->en_passant_sq, false, 0, board->fifty_move, noc);
-                        mi++;
-                        if(chess_rank_of(sq) == r_7 && board->square[sq - 16] == no) {
-                            t_cp = board->castle_perm;
-                            chess_move_set(&movelist[mi], sq, sq - 16, no, no, t_cp, board->castle_perm, sq - 8, board->en_passant_sq, false, 0, board->fifty_move, noc);
-                            mi++;
-                        }
-                    }
-                    if(chess_file_of(sq) != f_a) {
-                        if(board->square[sq - 9] > no) {
-                            t_cp = board->castle_perm;
-                            chess_move_set(&movelist[mi], sq, sq - 9, board->square[sq - 9], no, t_cp, board->castle_perm, NOSQ, board->en_passant_sq, false, 0, board->fifty_move, noc);
-                            mi++;
-                        }
-                    }
-                    if(chess_file_of(sq) != f_h) {
-                        if(board->square[sq - 7] > no) {
-                            t_cp = board->castle_perm;
-                            chess_move_set(&movelist[mi], sq, sq - 7, board->square[sq - 7], no, t_cp, board->castle_perm, NOSQ, board->en_passant_sq, false, 0, board->fifty_move, noc);
-                            mi++;
-                        }
-                    }
-                } else if(chess_rank_of(sq) == r_2) {
-                    if(board->square[sq - 8] == no) {
-                        t_cp = board->castle_perm;
-                        chess_move_set(&movelist[mi], sq, sq - 8, no, bq, t_cp, board->castle_perm, NOSQ, board->en_passant_sq, false, 0, board->fifty_move, noc);
+                while(targets) {
+                    to = chess_pop_lsb(&targets);
+                    if(board->square[to] == no) {
+                        chess_move_set(&movelist[mi], sq, to, no, no, t_cp, board->castle_perm, NOSQ, board->en_passant_sq, false, board->fifty_move + 1, board->fifty_move, noc);
                         mi++;
-                        chess_move_set(&movelist[mi], sq, sq - 8, no, bn, t_cp, board->castle_perm, NOSQ, board->en_passant_sq, false, 0, board->fifty_move, noc);
+                    } else if(board->square[to] * us < no) {
+                        chess_move_set(&movelist[mi], sq, to, board->square[to], no, t_cp, board->castle_perm, NOSQ, board->en_passant_sq, false, 0, board->fifty_move, noc);
                         mi++;
-                        chess_move_set(&movelist[mi], sq, sq - 8, no, bb, t_cp, board->castle_perm, NOSQ, board->en_passant_sq, false, 0, board->fifty_move, noc);
-                        mi++;
-                        chess_move_set(&movelist[mi], sq, sq - 8, no, br, t_cp, board->castle_perm, NOSQ, board->en_passant_sq, false, 0, board->fifty_move, noc);
-                        mi++;
-                    }
-                    if(chess_file_of(sq) != f_a) {
-                        if(board->square[sq - 9] > no) {
-                            t_cp = board->castle_perm;
-                            chess_move_set(&movelist[mi], sq, sq - 9, board->square[sq - 9], bq, t_cp, board->castle_perm, NOSQ, board->en_passant_sq, false, 0, board->fifty_move, noc);
-                            mi++;
-                            chess_move_set(&movelist[mi], sq, sq - 9, board->square[sq - 9], bn, t_cp, board->castle_perm, NOSQ, board->en_passant_sq, false, 0, board->fifty_move, noc);
-                            mi++;
-                            chess_move_set(&movelist[mi], sq, sq - 9, board->square[sq - 9], bb, t_cp, board->castle_perm, NOSQ, board->en_passant_sq, false, 0, board->fifty_move, noc);
-                            mi++;
-                            chess_move_set(&movelist[mi], sq, sq - 9, board->square[sq - 9], br, t_cp, board->castle_perm, NOSQ, board->en_passant_sq, false, 0, board->fifty_move, noc);
-                            mi++;
-                        }
-                    }
-                    if(chess_file_of(sq) != f_h) {
-                        if(board->square[sq - 7] > no) {
-                            t_cp = board->castle_perm;
-                            chess_move_set(&movelist[mi], sq, sq - 7, board->square[sq - 7], bq, t_cp, board->castle_perm, NOSQ, board->en_passant_sq, false, 0, board->fifty_move, noc);
-                            mi++;
-                            chess_move_set(&movelist[mi], sq, sq - 7, board->square[sq - 7], bn, t_cp, board->castle_perm, NOSQ, board->en_passant_sq, false, 0, board->fifty_move, noc);
-                            mi++;
-                            chess_move_set(&movelist[mi], sq, sq - 7, board->square[sq - 7], bb, t_cp, board->castle_perm, NOSQ, board->en_passant_sq, false, 0, board->fifty_move, noc);
-                            mi++;
-                            chess_move_set(&movelist[mi], sq, sq - 7, board->square[sq - 7], br, t_cp, board->castle_perm, NOSQ, board->en_passant_sq, false, 0, board->fifty_move, noc);
-                            mi++;
-                        }
                     }
                 }
                 break;
             }
-            case wn: {
-                if(stm == c_b) {
-                    break;
-                }
-                if(chess_file_of(sq) > f_a) {
-                    if(chess_rank_of(sq) > r_2) {
-                        if(board->square[sq - 17] == no) {
-                            t_cp = board->castle_perm;
-                            chess_move_set(&movelist[mi], sq, sq - 17, no, no, t_cp, board->castle_perm, NOSQ, board->en_passant_sq, false, board->fifty_move + 1, board->fifty_move, noc);
-                            mi++;
-                        } else if(board->square[sq - 17] < no) {
-                            t_cp = board->castle_perm;
-                            chess_move_set(&movelist[mi], sq, sq - 17, board->square[sq - 17], no, t_cp, board->castle_perm, NOSQ, board->en_passant_sq, false, 0, board->fifty_move, noc);
-                            mi++;
-                        }
-                    }
-                    if(chess_rank_of(sq) < r_7) {
-                        if(board->square[sq + 15] == no) {
-                            t_cp = board->castle_perm;
-                            chess_move_set(&movelist[mi], sq, sq + 15, no, no, t_cp, board->castle_perm, NOSQ, board->en_passant_sq, false, board->fifty_move + 1, board->fifty_move, noc);
-                            mi++;
-                        } else if(board->square[sq + 15] < no) {
-                            t_cp = board->castle_perm;
-                            chess_move_set(&movelist[mi], sq, sq + 15, board->square[sq + 15], no, t_cp, board->castle_perm, NOSQ, board->en_passant_sq, false, 0, board->fifty_move, noc);
-                            mi++;
-                        }
-                    }
-                }
-                if(chess_file_of(sq) > f_b) {
-                    if(chess_rank_of(sq) > r_1) {
-                        if(board->square[sq - 10] == no) {
-                            t_cp = board->castle_perm;
-                            chess_move_set(&movelist[mi], sq, sq - 10, no, no, t_cp, board->castle_perm, NOSQ, board->en_passant_sq, false, board->fifty_move + 1, board->fifty_move, noc);
-                            mi++;
-                        } else if(board->square[sq - 10] < no) {
-                            t_cp = board->castle_perm;
-                            chess_move_set(&movelist[mi], sq, sq - 10, board->square[sq - 10], no, t_cp, board->castle_perm, NOSQ, board->en_passant_sq, false, 0, board->fifty_move, noc);
-                            mi++;
-                        }
-                    }
-                    if(chess_rank_of(sq) < r_8) {
-                        if(board->square[sq + 6] == no) {
-                            t_cp = board->castle_perm;
-                            chess_move_set(&movelist[mi], sq, sq + 6, no, no, t_cp, board->castle_perm, NOSQ, board->en_passant_sq, false, board->fifty_move + 1, board->fifty_move, noc);
-                            mi++;
-                        } else if(board->square[sq + 6] < no) {
-                            t_cp = board->castle_perm;
-                            chess_move_set(&movelist[mi], sq, sq + 6, board->square[sq + 6], no, t_cp, board->castle_perm, NOSQ, board->en_passant_sq, false, 0, board->fifty_move, noc);
-                            mi++;
-                        }
-                    }
-                }
-                if(chess_file_of(sq) < f_g) {
-                    if(chess_rank_of(sq) > r_1) {
-                        if(board->square[sq - 6] == no) {
-                            t_cp = board->castle_perm;
-                            chess_move_set(&movelist[mi], sq, sq - 6, no, no, t_cp, board->castle_perm, NOSQ, board->en_passant_sq, false, board->fifty_move + 1, board->fifty_move, noc);
-                            mi++;
-                        } else if(board->square[sq - 6] < no) {
-                            t_cp = board->castle_perm;
-                            chess_move_set(&movelist[mi], sq, sq - 6, board->square[sq - 6], no, t_cp, board->castle_perm, NOSQ, board->en_passant_sq, false, 0, board->fifty_move, noc);
-                            mi++;
-                        }
-                    }
-                    if(chess_rank_of(sq) < r_8) {
-                        if(board->square[sq + 10] == no) {
-                            t_cp = board->castle_perm;
-                            chess_move_set(&movelist[mi], sq, sq + 10, no, no, t_cp, board->castle_perm, NOSQ, board->en_passant_sq, false, board->fifty_move + 1, board->fifty_move, noc);
-                            mi++;
-                        } else if(board->square[sq + 10] < no) {
-                            t_cp = board->castle_perm;
-                            chess_move_set(&movelist[mi], sq, sq + 10, board->square[sq + 10], no, t_cp, board->castle_perm, NOSQ, board->en_passant_sq, false, 0, board->fifty_move, noc);
-                            mi++;
-                        }
-                    }
-                }
-                if(chess_file_of(sq) < f_h) {
-                    if(chess_rank_of(sq) > r_2) {
-                        if(board->square[sq - 15] == no) {
-                            t_cp = board->castle_perm;
-                            chess_move_set(&movelist[mi], sq, sq - 15, no, no, t_cp, board->castle_perm, NOSQ, board->en_passant_sq, false, board->fifty_move + 1, board->fifty_move, noc);
-                            mi++;
-                        } else if(board->square[sq - 15] < no) {
-                            t_cp = board->castle_perm;
-                            chess_move_set(&movelist[mi], sq, sq - 15, board->square[sq - 15], no, t_cp, board->castle_perm, NOSQ, board->en_passant_sq, false, 0, board->fifty_move, noc);
-                            mi++;
-                        }
-                    }
-                    if(chess_rank_of(sq) < r_7) {
-                        if(board->square[sq + 17] == no) {
-                            t_cp = board->castle_perm;
-                            chess_move_set(&movelist[mi], sq, sq + 17, no, no, t_cp, board->castle_perm, NOSQ, board->en_passant_sq, false, board->fifty_move + 1, board->fifty_move, noc);
+            case wb:
+            case wr:
+            case wq: {
+                t_cp = board->castle_perm;
+                // Bishops use directions 0-3, rooks 4-7 and queens all 8
+                for(int64_t dir = piece == wr ? 4 : 0; dir < (piece == wb ? 4 : 8); dir++) {
+                    to = sq;
+                    for(int64_t i = 0; i < chess_ray_length[sq][dir]; i++) {
+                        to += chess_direction_offset[dir];
+                        if(board->square[to] == no) {
+                            chess_move_set(&movelist[mi], sq, to, no, no, t_cp, board->castle_perm, NOSQ, board->en_passant_sq, false, board->fifty_move + 1, board->fifty_move, noc);
                             mi++;
-                        } else if(board->square[sq + 17] < no) {
-                            t_cp = board->castle_perm;
-                            chess_move_set(&movelist[mi], sq, sq + 17, board->square[sq + 17], no, t_cp, board->castle_perm, NOSQ, board->en_passant_sq, false, 0, board->fifty_move, noc);
+                        } else if(board->square[to] * us < no) {
+                            chess_move_set(&movelist[mi], sq, to, board->square[to], no, t_cp, board->castle_perm, NOSQ, board->en_passant_sq, false, 0, board->fifty_move, noc);
                             mi++;
+                            break;
+                        } else {
+                            break;
                         }
                     }
                 }
                 break;
             }
-            case bn: {
-                if(stm == c_w) {
-                    break;
-                }
-                if(chess_file_of(sq) > f_a) {
-                    if(chess_rank_of(sq) > r_2) {
-                        if(board->square[sq - 17] == no) {
-                            t_cp = board->castle_perm;
-                            chess_move_set(&movelist[mi], sq, sq - 17, no, no, t_cp, board->castle_perm, NOSQ, board->en_passant_sq, false, board->fifty_move + 1, board->fifty_move, noc);
-                            mi++;
-                        } else if(board->square[sq - 17] > no) {
-                            t_cp = board->castle_perm;
-                            chess_move_set(&movelist[mi], sq, sq - 17, board->square[sq - 17], no, t_cp, board->castle_perm, NOSQ, board->en_passant_sq, false, 0, board->fifty_move, noc);
-                            mi++;
-                        }
-                    }
-                    if(chess_rank_of(sq) < r_7) {
-                        if(board->square[sq + 15] == no) {
-                            t_cp = board->castle_perm;
-                            chess_move_set(&movelist[mi], sq, sq + 15, no, no, t_cp, board->castle_perm, NOSQ, board->en_passant_sq, false, board->fifty_move + 1, board->fifty_move, noc);
-                            mi++;
-                        } else if(board->square[sq + 15] > no) {
-                            t_cp = board->castle_perm;
-                            chess_move_set(&movelist[mi], sq, sq + 15, board->square[sq + 15], no, t_cp, board->castle_perm, NOSQ, board->en_passant_sq, false, 0, board->fifty_move, noc);
-                            mi++;
-                        }
-                    }
-                }
-                if(chess_file_of(sq) > f_b) {
-                    if(chess_rank_of(sq) > r_1) {
-                        if(board->square[sq - 10] == no) {
-                            t_cp = board->castle_perm;
-                            chess_move_set(&movelist[mi], sq, sq - 10, no, no, t_cp, board->castle_perm, NOSQ, board->en_passant_sq, false, board->fifty_move + 1, board->fifty_move, noc);
-                            mi++;
-                        } else if(board->square[sq - 10] > no) {
-                            t_cp = board->castle_perm;
-                            chess_move_set(&movelist[mi], sq, sq - 10, board->square[sq - 10], no, t_cp, board->castle_perm, NOSQ, board->en_passant_sq, false, 0, board->fifty_move, noc);
-                            mi++;
-                        }
-                    }
-                    if(chess_rank_of(sq) < r_8) {
-                        if(board->square[sq + 6] == no) {
-                            t_cp = board->castle_perm;
-                            chess_move_set(&movelist[mi], sq, sq + 6, no, no, t_cp, board->castle_perm, NOSQ, board->en_passant_sq, false, board->fifty_move + 1, board->fifty_move, noc);
-                            mi++;
-                        } else if(board->square[sq + 6] > no) {
-                            t_cp = board->castle_perm;
-                            chess_move_set(&movelist[mi], sq, sq + 6, board->square[sq + 6], no, t_cp, board->castle_perm, NOSQ, board->en_passant_sq, false, 0, board->fifty_move, noc);
-                            mi++;
-                        }
-                    }
-                }
-                if(chess_file_of(sq) < f_g) {
-                    if(chess_rank_of(sq) > r_1) {
-                        if(board->square[sq - 6] == no) {
-                            t_cp = board->castle_perm;
-                            chess_move_set(&movelist[mi], sq, sq - 6, no, no, t_cp, board->castle_perm, NOSQ, board->en_passant_sq, false, board->fifty_move + 1, board->fifty_move, noc);
-                            mi++;
-                        } else if(board->square[sq - 6] > no) {
-                            t_cp = board->castle_perm;
-                            chess_move_set(&movelist[mi], sq, sq - 6, board->square[sq - 6], no, t_cp, board->castle_perm, NOSQ, board->en_passant_sq, false, 0, board->fifty_move, noc);
-                            mi++;
-                        }
-                    }
-                    if(chess_rank_of(sq) < r_8) {
-                        if(board->square[sq + 10] == no) {
-                            t_cp = board->castle_perm;
-                            chess_move_set(&movelist[mi], sq, sq + 10, no, no, t_cp, board->castle_perm, NOSQ, board->en_passant_sq, false, board->fifty_move + 1, board->fifty_move, noc);
-                            mi++;
-                        } else if(board->square[sq + 10] > no) {
-                            t_cp = board->castle_perm;
-                            chess_move_set(&movelist[mi], sq, sq + 10, board->square[sq + 10], no, t_cp, board->castle_perm, NOSQ, board->en_passant_sq, false, 0, board->fifty_move, noc);
-                            mi++;
-                        }
-                    }
-                }
-                if(chess_file_of(sq) < f_h) {
-                    if(chess_rank_of(sq) > r_2) {
-                        if(board->square[sq - 15] == no) {
-                            t_cp = board->castle_perm;
-                            chess_move_set(&movelist[mi], sq, sq - 15, no, no, t_cp, board->castle_perm, NOSQ, board->en_passant_sq, false, board->fifty_move + 1, board->fifty_move, noc);
-                            mi++;
-                        } else if(board->square[sq - 15] > no) {
-                            t_cp = board->castle_perm;
-                            chess_move_set(&movelist[mi], sq, sq - 15, board->square[sq - 15], no, t_cp, board->castle_perm, NOSQ, board->en_passant_sq, false, 0, board->fifty_move, noc);
-                            mi++;
-                        }
-                    }
-                    if(chess_rank_of(sq) < r_7) {
-                        if(board->square[sq + 17] == no) {
-                            t_cp = board->castle_perm;
-                            chess_move_set(&movelist[mi], sq, sq + 17, no, no, t_cp, board->castle_perm, NOSQ, board->en_passant_sq, false, board->fifty_move + 1, board->fifty_move, noc);
-                            mi++;
-                        } else if(board->square[sq + 17] > no) {
-                            t_cp = board->castle_perm;
-                            chess_move_set(&movelist[mi], sq, sq + 17, board->square[sq + 17], no, t_cp, board->castle_perm, NOSQ, board->en_passant_sq, false, 0, board->fifty_move, noc);
-                            mi++;
-                        }
-                    }
-                }
-                break;
+            default: {
+                fprintf(stderr, "ERROR: Expected -6 <= i <= 6, but got i = %ld at sq = %lu\n", (int64_t) board->square[sq], sq);
+                exit(1);
             }
-            case wb: {
-                if(stm == c_b) {
-                    break;
-                }
-                off = 9;
-                dir = 9;
-                while(sq + off < BOARDTOP) {
-                    if(chess_file_of(sq + off) == f_a) {
-                        break;
-                    }
-                    if(board->square[sq + off] == no) {
-                        t_cp = board->castle_perm;
-                        chess_move_set(&movelist[mi], sq, sq + off, no, no, t_cp, board->castle_perm, NOSQ, board->en_passant_sq, false, board->fifty_move + 1, board->fifty_move, noc);
-                        mi++;
-                    } else if(board->square[sq + off] < no) {
-                        t_cp = board->castle_perm;
-                        chess_move_set(&movelist[mi], sq, sq + off, board->square[sq + off], no, t_cp, board->castle_perm, NOSQ, board->en_passant_sq, false, 0, board->fifty_move, noc);
-                        mi++;
-                        break;
-                    } else {
-                        break;
-                    }
-                    off += dir;
-                }
-                off = 7;
-                dir = 7;
-                while(sq + off < BOARDTOP) {
-                    if(chess_file_of(sq + off) == f_h) {
-                        break;
-                    }
-                    if(board->square[sq + off] == no) {
-                        t_cp = board->castle_perm;
-                        chess_move_set(&movelist[mi], sq, sq + off, no, no, t_cp, board->castle_perm, NOSQ, board->en_passant_sq, false, board->fifty_move + 1, board->fifty_move, noc);
-                        mi++;
-                    } else if(board->square[sq + off] < no) {
-                        t_cp = board->castle_perm;
-                        chess_move_set(&movelist[mi], sq, sq + off, board->square[sq + off], no, t_cp, board->castle_perm, NOSQ, board->en_passant_sq, false, 0, board->fifty_move, noc);
-                        mi++;
-                        break;
-                    } else {
-                        break;
-                    }
-                    off += dir;
-                }
-                off = -7;
-                dir = -7;
-                while(sq + off > BOARDBOTTOM) {
-                    if(chess_file_of(sq + off) == f_a) {
-                        break;
-                    }
-                    if(board->square[sq + off] == no) {
-                        t_cp = board->castle_perm;
-                        chess_move_set(&movelist[mi], sq, sq + off, no, no, t_cp, board->castle_perm, NOSQ, board->en_passant_sq, false, board->fifty_move + 1, board->fifty_move, noc);
-                        mi++;
-                    } else if(board->square[sq + off] < no) {
-                        t_cp = board->castle_perm;
-                        chess_move_set(&movelist[mi], sq, sq + off, board->square[sq + off], no, t_cp, board->castle_perm, NOSQ, board->en_passant_sq, false, 0, board->fifty_move, noc);
-                        mi++;
-                        break;
-                    } else {
-                        break;
-                    }
-                    off += dir;
-                }
-                off = -9;
-                dir = -9;
-                while(sq + off > BOARDBOTTOM) {
-                    if(chess_file_of(sq + off) == f_h) {
-                        break;
-                    }
-                    if(board->square[sq + off] == no) {
-                        t_cp = board->castle_perm;
-                        chess_move_set(&movelist[mi], sq, sq + off, no, no, t_cp, board->castle_perm, NOSQ, board->en_passant_sq, false, board->fifty_move + 1, board->fifty_move, noc);
-                        mi++;
-                    } else if(board->square[sq + off] < no) {
-                        t_cp = board->castle_perm;
-                        chess_move_set(&movelist[mi], sq, sq + off, board->square[sq + off], no, t_cp, board->castle_perm, NOSQ, board->en_passant_sq, false, 0, board->fifty_move, noc);
-                        mi++;
-                        break;
-                    } else {
-                        break;
-                    }
-                    off += dir;
-                }
+        }
+        sq++;
+    }
+}
+CHESS_ALWAYS_INLINE bool chess_board_is_check_generic(board_t *board, const enum color us) {
+    const int64_t sq = us == c_w ? board->white_king_sq : board->black_king_sq;
+    const int64_t their_king_sq = us == c_w ? board->black_king_sq : board->white_king_sq;
+    int64_t to;
+    uint64_t targets;
+    // A kingless FEN leaves the king squares at NOSQ, which is past the end of every table
+    if(sq == NOSQ) {
+        return(false);
+    }
+    if(their_king_sq != NOSQ && (chess_king_attacks[sq] & CHESS_BIT(their_king_sq))) {
+        return(true);
+    }
+    for(int64_t dir = 0; dir < 8; dir++) {
+        // Bishops attack along directions 0-3, rooks along 4-7
+        const enum pieces slider = dir < 4 ? wb : wr;
+        to = sq;
+        for(int64_t i = 0; i < chess_ray_length[sq][dir]; i++) {
+            to += chess_direction_offset[dir];
+            if((board->square[to] == -us * slider) || (board->square[to] == -us * wq)) {
+                return(true);
+            } else if(board->square[to] != no) {
                 break;
             }
-            case bb: {
-                if(stm == c_w) {
-                    break;
-                }
-                off = 9;
-                dir = 9;
-                while(sq + off < BOARDTOP) {
-                    if(chess_file_of(sq + off) == f_a) {
-                        break;
-                    }
-                    if(board->square[sq + off] == no) {
-                        t_cp = board->castle_perm;
-                        chess_move_set(&movelist[mi], sq, sq + off, no, no, t_cp, board->castle_perm, NOSQ, board->en_passant_sq, false, board->fifty_move + 1, board->fifty_move, noc);
-                        mi++;
-                    } else if(board->square[sq + off] > no) {
-                        t_cp = board->castle_perm;
-                        chess_move_set(&movelist[mi], sq, sq + off, board->square[sq + off], no, t_cp, board->castle_perm, NOSQ, board->en_passant_sq, false, 0, board->fifty_move, noc);
-                        mi++;
-                        break;
-                    } else {
-                        break;
-                    }
-                    off += dir;
-                }
-                off = 7;
-                dir = 7;
-                while(sq + off < BOARDTOP) {
-                    if(chess_file_of(sq + off) == f_h) {
-                        break;
-                    }
-                    if(board->square[sq + off] == no) {
-                        t_cp = board->castle_perm;
-                        chess_move_set(&movelist[mi], sq, sq + off, no, no, t_cp, board->castle_perm, NOSQ, board->en_passant_sq, false, board->fifty_move + 1, board->fifty_move, noc);
-                        mi++;
-                    } else if(board->square[sq + off] > no) {
-                        t_cp = board->castle_perm;
-                        chess_move_set(&movelist[mi], sq, sq + off, board->square[sq + off], no, t_cp, board->castle_perm, NOSQ, board->en_passant_sq, false, 0, board->fifty_move, noc);
-                        mi++;
-                        break;
-                    } else {
-                        break;
-                    }
-                    off += dir;
-                }
-                off = -7;
-                dir = -7;
-                while(sq + off > BOARDBOTTOM) {
-                    if(chess_file_of(sq + off) == f_a) {
-                        break;
-                    }
-                    if(board->square[sq + off] == no) {
-                        t_cp = board->castle_perm;
-                        chess_move_set(&movelist[mi], sq, sq + off, no, no, t_cp, board->castle_perm, NOSQ, board->en_passant_sq, false, board->fifty_move + 1, board->fifty_move, noc);
-                        mi++;
-                    } else if(board->square[sq + off] > no) {
-                        t_cp = board->castle_perm;
-                        chess_move_set(&movelist[mi], sq, sq + off, board->square[sq + off], no, t_cp, board->castle_perm, NOSQ, board->en_passant_sq, false, 0, board->fifty_move, noc);
-                        mi++;
-                        break;
-                    } else {
-                        break;
-                    }
-                    off += dir;
-                }
-                off = -9;
-                dir = -9;
-                while(sq + off > BOARDBOTTOM) {
-                    if(chess_file_of(sq + off) == f_h) {
-                        break;
-                    }
-                    if(board->square[sq + off] == no) {
-                        t_cp = board->castle_perm;
-                        chess_move_set(&movelist[mi], sq, sq + off, no, no, t_cp, board->castle_perm, NOSQ, board->en_passant_sq, false, board->fifty_move + 1, board->fifty_move, noc);
-                        mi++;
-                    } else if(board->square[sq + off] > no) {
-                        t_cp = board->castle_perm;
-                        chess_move_set(&movelist[mi], sq, sq + off, board->square[sq + off], no, t_cp, board->castle_perm, NOSQ, board->en_passant_sq, false, 0, board->fifty_move, noc);
-                        mi++;
-                        break;
-                    } else {
-                        break;
-                    }
-                    off += dir;
-                }
-                break;
-            }
-            case wr: {
-                if(stm == c_b) {
-                    break;
-                }
-                off = 8;
-                dir = 8;
-                while(sq + off < BOARDTOP) {
-                    if(board->square[sq + off] == no) {
-                        t_cp = board->castle_perm;
-                        chess_move_set(&movelist[mi], sq, sq + off, no, no, t_cp, board->castle_perm, NOSQ, board->en_passant_sq, false, board->fifty_move + 1, board->fifty_move, noc);
-                        mi++;
-                    } else if(board->square[sq + off] < no) {
-                        t_cp = board->castle_perm;
-                        chess_move_set(&movelist[mi], sq, sq + off, board->square[sq + off], no, t_cp, board->castle_perm, NOSQ, board->en_passant_sq, false, 0, board->fifty_move, noc);
-                        mi++;
-                        break;
-                    } else {
-                        break;
-                    }
-                    off += dir;
-                }
-                off = 1;
-                dir = 1;
-                while(sq + off < BOARDTOP) {
-                    if(chess_file_of(sq + off) == f_a) {
-                        break;
-                    }
-                    if(board->square[sq + off] == no) {
-                        t_cp = board->castle_perm;
-                        chess_move_set(&movelist[mi], sq, sq + off, no, no, t_cp, board->castle_perm, NOSQ, board->en_passant_sq, false, board->fifty_move + 1, board->fifty_move, noc);
-                        mi++;
-                    } else if(board->square[sq + off] < no) {
-                        t_cp = board->castle_perm;
-                        chess_move_set(&movelist[mi], sq, sq + off, board->square[sq + off], no, t_cp, board->castle_perm, NOSQ, board->en_passant_sq, false, 0, board->fifty_move, noc);
-                        mi++;
-                        break;
-                    } else {
-                        break;
-                    }
-                    off += dir;
-                }
-                off = -1;
-                dir = -1;
-                while(sq + off > BOARDBOTTOM) {
-                    if(chess_file_of(sq + off) == f_h) {
-                        break;
-                    }
-                    if(board->square[sq + off] == no) {
-                        t_cp = board->castle_perm;
-                        chess_move_set(&movelist[mi], sq, sq + off, no, no, t_cp, board->castle_perm, NOSQ, board->en_passant_sq, false, board->fifty_move + 1, board->fifty_move, noc);
-                        mi++;
-                    } else if(board->square[sq + off] < no) {
-                        t_cp = board->castle_perm;
-                        chess_move_set(&movelist[mi], sq, sq + off, board->square[sq + off], no, t_cp, board->castle_perm, NOSQ, board->en_passant_sq, false, 0, board->fifty_move, noc);
-                        mi++;
-                        break;
-                    } else {
-                        break;
-                    }
-                    off += dir;
-                }
-                off = -8;
-                dir = -8;
-                while(sq + off > BOARDBOTTOM) {
-                    if(board->square[sq + off] == no) {
-                        t_cp = board->castle_perm;
-                        chess_move_set(&movelist[mi], sq, sq + off, no, no, t_cp, board->castle_perm, NOSQ, board->en_passant_sq, false, board->fifty_move + 1, board->fifty_move, noc);
-                        mi++;
-                    } else if(board->square[sq + off] < no) {
-                        t_cp = board->castle_perm;
-                        chess_move_set(&movelist[mi], sq, sq + off, board->square[sq + off], no, t_cp, board->castle_perm, NOSQ, board->en_passant_sq, false, 0, board->fifty_move, noc);
-                        mi++;
-                        break;
-                    } else {
-                        break;
-                    }
-                    off += dir;
-                }
-                break;
-            }
-            case br: {
-                if(stm == c_w) {
-                    break;
-                }
-                off = 8;
-                dir = 8;
-                while(sq + off < BOARDTOP) {
-                    if(board->square[sq + off] == no) {
-                        t_cp = board->castle_perm;
-                        chess_move_set(&movelist[mi], sq, sq + off, no, no, t_cp, board->castle_perm, NOSQ, board->en_passant_sq, false, board->fifty_move + 1, board->fifty_move, noc);
-                        mi++;
-                    } else if(board->square[sq + off] > no) {
-                        t_cp = board->castle_perm;
-                        chess_move_set(&movelist[mi], sq, sq + off, board->square[sq + off], no, t_cp, board->castle_perm, NOSQ, board->en_passant_sq, false, 0, board->fifty_move, noc);
-                        mi++;
-                        break;
-                    } else {
-                        break;
-                    }
-                    off += dir;
-                }
-                off = 1;
-                dir = 1;
-                while(sq + off < BOARDTOP) {
-                    if(chess_file_of(sq + off) == f_a) {
-                        break;
-                    }
-                    if(board->square[sq + off] == no) {
-                        t_cp = board->castle_perm;
-                        chess_move_set(&movelist[mi], sq, sq + off, no, no, t_cp, board->castle_perm, NOSQ, board->en_passant_sq, false, board->fifty_move + 1, board->fifty_move, noc);
-                        mi++;
-                    } else if(board->square[sq + off] > no) {
-                        t_cp = board->castle_perm;
-                        chess_move_set(&movelist[mi], sq, sq + off, board->square[sq + off], no, t_cp, board->castle_perm, NOSQ, board->en_passant_sq, false, 0, board->fifty_move, noc);
-                        mi++;
-                        break;
-                    } else {
-                        break;
-                    }
-                    off += dir;
-                }
-                off = -1;
-                dir = -1;
-                while(sq + off > BOARDBOTTOM) {
-                    if(chess_file_of(sq + off) == f_h) {
-                        break;
-                    }
-                    if(board->square[sq + off] == no) {
-                        t_cp = board->castle_perm;
-                        chess_move_set(&movelist[mi], sq, sq + off, no, no, t_cp, board->castle_perm, NOSQ, board->en_passant_sq, false, board->fifty_move + 1, board->fifty_move, noc);
-                        mi++;
-                    } else if(board->square[sq + off] > no) {
-                        t_cp = board->castle_perm;
-                        chess_move_set(&movelist[mi], sq, sq + off, board->square[sq + off], no, t_cp, board->castle_perm, NOSQ, board->en_passant_sq, false, 0, board->fifty_move, noc);
-                        mi++;
-                        break;
-                    } else {
-                        break;
-                    }
-                    off += dir;
-                }
-                off = -8;
-                dir = -8;
-                while(sq + off > BOARDBOTTOM) {
-                    if(board->square[sq + off] == no) {
-                        t_cp = board->castle_perm;
-                        chess_move_set(&movelist[mi], sq, sq + off, no, no, t_cp, board->castle_perm, NOSQ, board->en_passant_sq, false, board->fifty_move + 1, board->fifty_move, noc);
-                        mi++;
-                    } else if(board->square[sq + off] > no) {
-                        t_cp = board->castle_perm;
-                        chess_move_set(&movelist[mi], sq, sq + off, board->square[sq + off], no, t_cp, board->castle_perm, NOSQ, board->en_passant_sq, false, 0, board->fifty_move, noc);
-                        mi++;
-                        break;
-                    } else {
-                        break;
-                    }
-                    off += dir;
-                }
-                break;
-            }
-            case wq: {
-                if(stm == c_b) {
-                    break;
-                }
-                off = 9;
-                dir = 9;
-                while(sq + off < BOARDTOP) {
-                    if(chess_file_of(sq + off) == f_a) {
-                        break;
-                    }
-                    if(board->square[sq + off] == no) {
-                        t_cp = board->castle_perm;
-                        chess_move_set(&movelist[mi], sq, sq + off, no, no, t_cp, board->castle_perm, NOSQ, board->en_passant_sq, false, board->fifty_move + 1, board->fifty_move, noc);
-                        mi++;
-                    } else if(board->square[sq + off] < no) {
-                        t_cp = board->castle_perm;
-                        chess_move_set(&movelist[mi], sq, sq + off, board->square[sq + off], no, t_cp, board->castle_perm, NOSQ, board->en_passant_sq, false, 0, board->fifty_move, noc);
-                        mi++;
-                        break;
-                    } else {
-                        break;
-                    }
-                    off += dir;
-                }
-                off = 7;
-                dir = 7;
-                while(sq + off < BOARDTOP) {
-                    if(chess_file_of(sq + off) == f_h) {
-                        break;
-                    }
-                    if(board->square[sq + off] == no) {
-                        t_cp = board->castle_perm;
-                        chess_move_set(&movelist[mi], sq, sq + off, no, no, t_cp, board->castle_perm, NOSQ, board->en_passant_sq, false, board->fifty_move + 1, board->fifty_move, noc);
-                        mi++;
-                    } else if(board->square[sq + off] < no) {
-                        t_cp = board->castle_perm;
-                        chess_move_set(&movelist[mi], sq, sq + off, board->square[sq + off], no, t_cp, board->castle_perm, NOSQ, board->en_passant_sq, false, 0, board->fifty_move, noc);
-                        mi++;
-                        break;
-                    } else {
-                        break;
-                    }
-                    off += dir;
-                }
-                off = -7;
-                dir = -7;
-                while(sq + off > BOARDBOTTOM) {
-                    if(chess_file_of(sq + off) == f_a) {
-                        break;
-                    }
-                    if(board->square[sq + off] == no) {
-                        t_cp = board->castle_perm;
-                        chess_move_set(&movelist[mi], sq, sq + off, no, no, t_cp, board->castle_perm, NOSQ, board->en_passant_sq, false, board->fifty_move + 1, board->fifty_move, noc);
-                        mi++;
-                    } else if(board->square[sq + off] < no) {
-                        t_cp = board->castle_perm;
-                        chess_move_set(&movelist[mi], sq, sq + off, board->square[sq + off], no, t_cp, board->castle_perm, NOSQ, board->en_passant_sq, false, 0, board->fifty_move, noc);
-                        mi++;
-                        break;
-                    } else {
-                        break;
-                    }
-                    off += dir;
-                }
-                off = -9;
-                dir = -9;
-                while(sq + off > BOARDBOTTOM) {
-                    if(chess_file_of(sq + off) == f_h) {
-                        break;
-                    }
-                    if(board->square[sq + off] == no) {
-                        t_cp = board->castle_perm;
-                        chess_move_set(&movelist[mi], sq, sq + off, no, no, t_cp, board->castle_perm, NOSQ, board->en_passant_sq, false, board->fifty_move + 1, board->fifty_move, noc);
-                        mi++;
-                    } else if(board->square[sq + off] < no) {
-                        t_cp = board->castle_perm;
-                        chess_move_set(&movelist[mi], sq, sq + off, board->square[sq + off], no, t_cp, board->castle_perm, NOSQ, board->en_passant_sq, false, 0, board->fifty_move, noc);
-                        mi++;
-                        break;
-                    } else {
-                        break;
-                    }
-                    off += dir;
-                }
-                off = 8;
-                dir = 8;
-                while(sq + off < BOARDTOP) {
-                    if(board->square[sq + off] == no) {
-                        t_cp = board->castle_perm;
-                        chess_move_set(&movelist[mi], sq, sq + off, no, no, t_cp, board->castle_perm, NOSQ, board->en_passant_sq, false, board->fifty_move + 1, board->fifty_move, noc);
-                        mi++;
-                    } else if(board->square[sq + off] < no) {
-                        t_cp = board->castle_perm;
-                        chess_move_set(&movelist[mi], sq, sq + off, board->square[sq + off], no, t_cp, board->castle_perm, NOSQ, board->en_passant_sq, false, 0, board->fifty_move, noc);
-                        mi++;
-                        break;
-                    } else {
-                        break;
-                    }
-                    off += dir;
-                }
-                off = 1;
-                dir = 1;
-                while(sq + off < BOARDTOP) {
-                    if(chess_file_of(sq + off) == f_a) {
-                        break;
-                    }
-                    if(board->square[sq + off] == no) {
-                        t_cp = board->castle_perm;
-                        chess_move_set(&movelist[mi], sq, sq + off, no, no, t_cp, board->castle_perm, NOSQ, board->en_passant_sq, false, board->fifty_move + 1, board->fifty_move, noc);
-                        mi++;
-                    } else if(board->square[sq + off] < no) {
-                        t_cp = board->castle_perm;
-                        chess_move_set(&movelist[mi], sq, sq + off, board->square[sq + off], no, t_cp, board->castle_perm, NOSQ, board->en_passant_sq, false, 0, board->fifty_move, noc);
-                        mi++;
-                        break;
-                    } else {
-                        break;
-                    }
-                    off += dir;
-                }
-                off = -1;
-                dir = -1;
-                while(sq + off > BOARDBOTTOM) {
-                    if(chess_file_of(sq + off) == f_h) {
-                        break;
-                    }
-                    if(board->square[sq + off] == no) {
-                        t_cp = board->castle_perm;
-                        chess_move_set(&movelist[mi], sq, sq + off, no, no, t_cp, board->castle_perm, NOSQ, board->en_passant_sq, false, board->fifty_move + 1, board->fifty_move, noc);
-                        mi++;
-                    } else if(board->square[sq + off] < no) {
-                        t_cp = board->castle_perm;
-                        chess_move_set(&movelist[mi], sq, sq + off, board->square[sq + off], no, t_cp, board->castle_perm, NOSQ, board->en_passant_sq, false, 0, board->fifty_move, noc);
-                        mi++;
-                        break;
-                    } else {
-                        break;
-                    }
-                    off += dir;
-                }
-                off = -8;
-                dir = -8;
-                while(sq + off > BOARDBOTTOM) {
-                    if(board->square[sq + off] == no) {
-                        t_cp = board->castle_perm;
-                        chess_move_set(&movelist[mi], sq, sq + off, no, no, t_cp, board->castle_perm, NOSQ, board->en_passant_sq, false, board->fifty_move + 1, board->fifty_move, noc);
-                        mi++;
-                    } else if(board->square[sq + off] < no) {
-                        t_cp = board->castle_perm;
-                        chess_move_set(&movelist[mi], sq, sq + off, board->square[sq + off], no, t_cp, board->castle_perm, NOSQ, board->en_passant_sq, false, 0, board->fifty_move, noc);
-                        mi++;
-                        break;
-                    } else {
-                        break;
-                    }
-                    off += dir;
-                }
-                break;
-            }
-            case bq: {
-                if(stm == c_w) {
-                    break;
-                }
-                off = 9;
-                dir = 9;
-                while(sq + off < BOARDTOP) {
-                    if(chess_file_of(sq + off) == f_a) {
-                        break;
-                    }
-                    if(board->square[sq + off] == no) {
-                        t_cp = board->castle_perm;
-                        chess_move_set(&movelist[mi], sq, sq + off, no, no, t_cp, board->castle_perm, NOSQ, board->en_passant_sq, false, board->fifty_move + 1, board->fifty_move, noc);
-                        mi++;
-                    } else if(board->square[sq + off] > no) {
-                        t_cp = board->castle_perm;
-                        chess_move_set(&movelist[mi], sq, sq + off, board->square[sq + off], no, t_cp, board->castle_perm, NOSQ, board->en_passant_sq, false, 0, board->fifty_move, noc);
-                        mi++;
-                        break;
-                    } else {
-                        break;
-                    }
-                    off += dir;
-                }
-                off = 7;
-                dir = 7;
-                while(sq + off < BOARDTOP) {
-                    if(chess_file_of(sq + off) == f_h) {
-                        break;
-                    }
-                    if(board->square[sq + off] == no) {
-                        t_cp = board->castle_perm;
-                        chess_move_set(&movelist[mi], sq, sq + off, no, no, t_cp, board->castle_perm, NOSQ, board->en_passant_sq, false, board->fifty_move + 1, board->fifty_move, noc);
-                        mi++;
-                    } else if(board->square[sq + off] > no) {
-                        t_cp = board->castle_perm;
-                        chess_move_set(&movelist[mi], sq, sq + off, board->square[sq + off], no, t_cp, board->castle_perm, NOSQ, board->en_passant_sq, false, 0, board->fifty_move, noc);
-                        mi++;
-                        break;
-                    } else {
-                        break;
-                    }
-                    off += dir;
-                }
-                off = -7;
-                dir = -7;
-                while(sq + off > BOARDBOTTOM) {
-                    if(chess_file_of(sq + off) == f_a) {
-                        break;
-                    }
-                    if(board->square[sq + off] == no) {
-                        t_cp = board->castle_perm;
-                        chess_move_set(&movelist[mi], sq, sq + off, no, no, t_cp, board->castle_perm, NOSQ, board->en_passant_sq, false, board->fifty_move + 1, board->fifty_move, noc);
-                        mi++;
-                    } else if(board->square[sq + off] > no) {
-                        t_cp = board->castle_perm;
-                        chess_move_set(&movelist[mi], sq, sq + off, board->square[sq + off], no, t_cp, board->castle_perm, NOSQ, board->en_passant_sq, false, 0, board->fifty_move, noc);
-                        mi++;
-                        break;
-                    } else {
-                        break;
-                    }
-                    off += dir;
-                }
-                off = -9;
-                dir = -9;
-                while(sq + off > BOARDBOTTOM) {
-                    if(chess_file_of(sq + off) == f_h) {
-                        break;
-                    }
-                    if(board->square[sq + off] == no) {
-                        t_cp = board->castle_perm;
-                        chess_move_set(&movelist[mi], sq, sq + off, no, no, t_cp, board->castle_perm, NOSQ, board->en_passant_sq, false, board->fifty_move + 1, board->fifty_move, noc);
-                        mi++;
-                    } else if(board->square[sq + off] > no) {
-                        t_cp = board->castle_perm;
-                        chess_move_set(&movelist[mi], sq, sq + off, board->square[sq + off], no, t_cp, board->castle_perm, NOSQ, board->en_passant_sq, false, 0, board->fifty_move, noc);
-                        mi++;
-                        break;
-                    } else {
-                        break;
-                    }
-                    off += dir;
-                }
-                off = 8;
-                dir = 8;
-                while(sq + off < BOARDTOP) {
-                    if(board->square[sq + off] == no) {
-                        t_cp = board->castle_perm;
-                        chess_move_set(&movelist[mi], sq, sq + off, no, no, t_cp, board->castle_perm, NOSQ, board->en_passant_sq, false, board->fifty_move + 1, board->fifty_move, noc);
-                        mi++;
-                    } else if(board->square[sq + off] > no) {
-                        t_cp = board->castle_perm;
-                        chess_move_set(&movelist[mi], sq, sq + off, board->square[sq + off], no, t_cp, board->castle_perm, NOSQ, board->en_passant_sq, false, 0, board->fifty_move, noc);
-                        mi++;
-                        break;
-                    } else {
-                        break;
-                    }
-                    off += dir;
-                }
-                off = 1;
-                dir = 1;
-                while(sq + off < BOARDTOP) {
-                    if(chess_file_of(sq + off) == f_a) {
-                        break;
-                    }
-                    if(board->square[sq + off] == no) {
-                        t_cp = board->castle_perm;
-                        chess_move_set(&movelist[mi], sq, sq + off, no, no, t_cp, board->castle_perm, NOSQ, board->en_passant_sq, false, board->fifty_move + 1, board->fifty_move, noc);
-                        mi++;
-                    } else if(board->square[sq + off] > no) {
-                        t_cp = board->castle_perm;
-                        chess_move_set(&movelist[mi], sq, sq + off, board->square[sq + off], no, t_cp, board->castle_perm, NOSQ, board->en_passant_sq, false, 0, board->fifty_move, noc);
-                        mi++;
-                        break;
-                    } else {
-                        break;
-                    }
-                    off += dir;
-                }
-                off = -1;
-                dir = -1;
-                while(sq + off > BOARDBOTTOM) {
-                    if(chess_file_of(sq + off) == f_h) {
-                        break;
-                    }
-                    if(board->square[sq + off] == no) {
-                        t_cp = board->castle_perm;
-                        chess_move_set(&movelist[mi], sq, sq + off, no, no, t_cp, board->castle_perm, NOSQ, board->en_passant_sq, false, board->fifty_move + 1, board->fifty_move, noc);
-                        mi++;
-                    } else if(board->square[sq + off] > no) {
-                        t_cp = board->castle_perm;
-                        chess_move_set(&movelist[mi], sq, sq + off, board->square[sq + off], no, t_cp, board->castle_perm, NOSQ, board->en_passant_sq, false, 0, board->fifty_move, noc);
-                        mi++;
-                        break;
-                    } else {
-                        break;
-                    }
-                    off += dir;
-                }
-                off = -8;
-                dir = -8;
-                while(sq + off > BOARDBOTTOM) {
-                    if(board->square[sq + off] == no) {
-                        t_cp = board->castle_perm;
-                        chess_move_set(&movelist[mi], sq, sq + off, no, no, t_cp, board->castle_perm, NOSQ, board->en_passant_sq, false, board->fifty_move + 1, board->fifty_move, noc);
-                        mi++;
-                    } else if(board->square[sq + off] > no) {
-                        t_cp = board->castle_perm;
-                        chess_move_set(&movelist[mi], sq, sq + off, board->square[sq + off], no, t_cp, board->castle_perm, NOSQ, board->en_passant_sq, false, 0, board->fifty_move, noc);
-                        mi++;
-                        break;
-                    } else {
-                        break;
-                    }
-                    off += dir;
-                }
-                break;
-            }
-            case wk: {
-                if(stm == c_b) {
-                    break;
-                }
-                if(chess_rank_of(sq) > r_1) {
-                    if(board->square[sq - 8] == no) {
-                        t_cp = board->castle_perm;
-                        BITOFF(t_cp, wkc);
-                        BITOFF(t_cp, wqc);
-                        chess_move_set(&movelist[mi], sq, sq - 8, no, no, t_cp, board->castle_perm, NOSQ, board->en_passant_sq, false, board->fifty_move + 1, board->fifty_move, noc);
-                        mi++;
-                    } else if(board->square[sq - 8] < no) {
-                        t_cp = board->castle_perm;
-                        BITOFF(t_cp, wkc);
-                        BITOFF(t_cp, wqc);
-                        chess_move_set(&movelist[mi], sq, sq - 8, board->square[sq - 8], no, t_cp, board->castle_perm, NOSQ, board->en_passant_sq, false, 0, board->fifty_move, noc);
-                        mi++;
-                    }
-                }
-                if(chess_rank_of(sq) < r_8) {
-                    if(board->square[sq + 8] == no) {
-                        t_cp = board->castle_perm;
-                        BITOFF(t_cp, wkc);
-                        BITOFF(t_cp, wqc);
-                        chess_move_set(&movelist[mi], sq, sq + 8, no, no, t_cp, board->castle_perm, NOSQ, board->en_passant_sq, false, board->fifty_move + 1, board->fifty_move, noc);
-                        mi++;
-                    } else if(board->square[sq + 8] < no) {
-                        t_cp = board->castle_perm;
-                        BITOFF(t_cp, wkc);
-                        BITOFF(t_cp, wqc);
-                        chess_move_set(&movelist[mi], sq, sq + 8, board->square[sq + 8], no, t_cp, board->castle_perm, NOSQ, board->en_passant_sq, false, 0, board->fifty_move, noc);
-                        mi++;
-                    }
-                }
-                if(chess_file_of(sq) > f_a) {
-                    if(board->square[sq - 1] == no) {
-                        t_cp = board->castle_perm;
-                        BITOFF(t_cp, wkc);
-                        BITOFF(t_cp, wqc);
-                        chess_move_set(&movelist[mi], sq, sq - 1, no, no, t_cp, board->castle_perm, NOSQ, board->en_passant_sq, false, board->fifty_move + 1, board->fifty_move, noc);
-                        mi++;
-                    } else if(board->square[sq - 1] < no) {
-                        t_cp = board->castle_perm;
-                        BITOFF(t_cp, wkc);
-                        BITOFF(t_cp, wqc);
-                        chess_move_set(&movelist[mi], sq, sq - 1, board->square[sq - 1], no, t_cp, board->castle_perm, NOSQ, board->en_passant_sq, false, 0, board->fifty_move, noc);
-                        mi++;
-                    }
-                    if(chess_rank_of(sq) > r_1) {
-                        if(board->square[sq - 9] == no) {
-                            t_cp = board->castle_perm;
-                            BITOFF(t_cp, wkc);
-                            BITOFF(t_cp, wqc);
-                            chess_move_set(&movelist[mi], sq, sq - 9, no, no, t_cp, board->castle_perm, NOSQ, board->en_passant_sq, false, board->fifty_move + 1, board->fifty_move, noc);
-                            mi++;
-                        } else if(board->square[sq - 9] < no) {
-                            t_cp = board->castle_perm;
-                            BITOFF(t_cp, wkc);
-                            BITOFF(t_cp, wqc);
-                            chess_move_set(&movelist[mi], sq, sq - 9, board->square[sq - 9], no, t_cp, board->castle_perm, NOSQ, board->en_passant_sq, false, 0, board->fifty_move, noc);
-                            mi++;
-                        }
-                    } else if(chess_rank_of(sq) < r_8) {
-                        if(board->square[sq + 7] == no) {
-                            t_cp = board->castle_perm;
-                            BITOFF(t_cp, wkc);
-                            BITOFF(t_cp, wqc);
-                            chess_move_set(&movelist[mi], sq, sq + 7, no, no, t_cp, board->castle_perm, NOSQ, board->en_passant_sq, false, board->fifty_move + 1, board->fifty_move, noc);
-                            mi++;
-                        } else if(board->square[sq + 7] < no) {
-                            t_cp = board->castle_perm;
-                            BITOFF(t_cp, wkc);
-                            BITOFF(t_cp, wqc);
-                            chess_move_set(&movelist[mi], sq, sq + 7, board->square[sq + 7], no, t_cp, board->castle_perm, NOSQ, board->en_passant_sq, false, 0, board->fifty_move, noc);
-                            mi++;
-                        }
-                    } 
-                }
-                if(chess_file_of(sq) < f_h) {
-                    if(board->square[sq + 1] == no) {
-                        t_cp = board->castle_perm;
-                        BITOFF(t_cp, wkc);
-                        BITOFF(t_cp, wqc);
-                        chess_move_set(&movelist[mi], sq, sq + 1, no, no, t_cp, board->castle_perm, NOSQ, board->en_passant_sq, false, board->fifty_move + 1, board->fifty_move, noc);
-                        mi++;
-                    } else if(board->square[sq + 1] < no) {
-                        t_cp = board->castle_perm;
-                        BITOFF(t_cp, wkc);
-                        BITOFF(t_cp, wqc);
-                        chess_move_set(&movelist[mi], sq, sq + 1, board->square[sq + 1], no, t_cp, board->castle_perm, NOSQ, board->en_passant_sq, false, 0, board->fifty_move, noc);
-                        mi++;
-                    }
-                    if(chess_rank_of(sq) > r_1) {
-                        if(board->square[sq - 7] == no) {
-                            t_cp = board->castle_perm;
-                            BITOFF(t_cp, wkc);
-                            BITOFF(t_cp, wqc);
-                            chess_move_set(&movelist[mi], sq, sq - 7, no, no, t_cp, board->castle_perm, NOSQ, board->en_passant_sq, false, board->fifty_move + 1, board->fifty_move, noc);
-                            mi++;
-                        } else if(board->square[sq - 7] < no) {
-                            t_cp = board->castle_perm;
-                            BITOFF(t_cp, wkc);
-                            BITOFF(t_cp, wqc);
-                            chess_move_set(&movelist[mi], sq, sq - 7, board->square[sq - 7], no, t_cp, board->castle_perm, NOSQ, board->en_passant_sq, false, 0, board->fifty_move, noc);
-                            mi++;
-                        }
-                    } else if(chess_rank_of(sq) < r_8) {
-                        if(board->square[sq + 9] == no) {
-                            t_cp = board->castle_perm;
-                            BITOFF(t_cp, wkc);
-                            BITOFF(t_cp, wqc);
-                            chess_move_set(&movelist[mi], sq, sq + 9, no, no, t_cp, board->castle_perm, NOSQ, board->en_passant_sq, false, board->fifty_move + 1, board->fifty_move, noc);
-                            mi++;
-                        } else if(board->square[sq + 9] < no) {
-                            t_cp = board->castle_perm;
-                            BITOFF(t_cp, wkc);
-                            BITOFF(t_cp, wqc);
-                            chess_move_set(&movelist[mi], sq, sq + 9, board->square[sq + 9], no, t_cp, board->castle_perm, NOSQ, board->en_passant_sq, false, 0, board->fifty_move, noc);
-                            mi++;
-                        }
-                    } 
-                }
-                break;
-            }
-            case bk: {
-                if(stm == c_w) {
-                    break;
-                }
-                if(chess_rank_of(sq) > r_1) {
-                    if(board->square[sq - 8] == no) {
-                        t_cp = board->castle_perm;
-                        BITOFF(t_cp, bkc);
-                        BITOFF(t_cp, bqc);
-                        chess_move_set(&movelist[mi], sq, sq - 8, no, no, t_cp, board->castle_perm, NOSQ, board->en_passant_sq, false, board->fifty_move + 1, board->fifty_move, noc);
-                        mi++;
-                    } else if(board->square[sq - 8] > no) {
-                        t_cp = board->castle_perm;
-                        BITOFF(t_cp, bkc);
-                        BITOFF(t_cp, bqc);
-                        chess_move_set(&movelist[mi], sq, sq - 8, board->square[sq - 8], no, t_cp, board->castle_perm, NOSQ, board->en_passant_sq, false, 0, board->fifty_move, noc);
-                        mi++;
-                    }
-                }
-                if(chess_rank_of(sq) < r_8) {
-                    if(board->square[sq + 8] == no) {
-                        t_cp = board->castle_perm;
-                        BITOFF(t_cp, bkc);
-                        BITOFF(t_cp, bqc);
-                        chess_move_set(&movelist[mi], sq, sq + 8, no, no, t_cp, board->castle_perm, NOSQ, board->en_passant_sq, false, board->fifty_move + 1, board->fifty_move, noc);
-                        mi++;
-                    } else if(board->square[sq + 8] > no) {
-                        t_cp = board->castle_perm;
-                        BITOFF(t_cp, bkc);
-                        BITOFF(t_cp, bqc);
-                        chess_move_set(&movelist[mi], sq, sq + 8, board->square[sq + 8], no, t_cp, board->castle_perm, NOSQ, board->en_passant_sq, false, 0, board->fifty_move, noc);
-                        mi++;
-                    }
-                }
-                if(chess_file_of(sq) > f_a) {
-                    if(board->square[sq - 1] == no) {
-                        t_cp = board->castle_perm;
-                        BITOFF(t_cp, bkc);
-                        BITOFF(t_cp, bqc);
-                        chess_move_set(&movelist[mi], sq, sq - 1, no, no, t_cp, board->castle_perm, NOSQ, board->en_passant_sq, false, board->fifty_move + 1, board->fifty_move, noc);
-                        mi++;
-                    } else if(board->square[sq - 1] > no) {
-                        t_cp = board->castle_perm;
-                        BITOFF(t_cp, bkc);
-                        BITOFF(t_cp, bqc);
-                        chess_move_set(&movelist[mi], sq, sq - 1, board->square[sq - 1], no, t_cp, board->castle_perm, NOSQ, board->en_passant_sq, false, 0, board->fifty_move, noc);
-                        mi++;
-                    }
-                    if(chess_rank_of(sq) > r_1) {
-                        if(board->square[sq - 9] == no) {
-                            t_cp = board->castle_perm;
-                            BITOFF(t_cp, bkc);
-                            BITOFF(t_cp, bqc);
-                            chess_move_set(&movelist[mi], sq, sq - 9, no, no, t_cp, board->castle_perm, NOSQ, board->en_passant_sq, false, board->fifty_move + 1, board->fifty_move, noc);
-                            mi++;
-                        } else if(board->square[sq - 9] > no) {
-                            t_cp = board->castle_perm;
-                            BITOFF(t_cp, bkc);
-                            BITOFF(t_cp, bqc);
-                            chess_move_set(&movelist[mi], sq, sq - 9, board->square[sq - 9], no, t_cp, board->castle_perm, NOSQ, board->en_passant_sq, false, 0, board->fifty_move, noc);
-                            mi++;
-                        }
-                    } else if(chess_rank_of(sq) < r_8) {
-                        if(board->square[sq + 7] == no) {
-                            t_cp = board->castle_perm;
-                            BITOFF(t_cp, bkc);
-                            BITOFF(t_cp, bqc);
-                            chess_move_set(&movelist[mi], sq, sq + 7, no, no, t_cp, board->castle_perm, NOSQ, board->en_passant_sq, false, board->fifty_move + 1, board->fifty_move, noc);
-                            mi++;
-                        } else if(board->square[sq + 7] > no) {
-                            t_cp = board->castle_perm;
-                            BITOFF(t_cp, bkc);
-                            BITOFF(t_cp, bqc);
-                            chess_move_set(&movelist[mi], sq, sq + 7, board->square[sq + 7], no, t_cp, board->castle_perm, NOSQ, board->en_passant_sq, false, 0, board->fifty_move, noc);
-                            mi++;
-                        }
-                    } 
-                }
-                if(chess_file_of(sq) < f_h) {
-                    if(board->square[sq + 1] == no) {
-                        t_cp = board->castle_perm;
-                        BITOFF(t_cp, bkc);
-                        BITOFF(t_cp, bqc);
-                        chess_move_set(&movelist[mi], sq, sq + 1, no, no, t_cp, board->castle_perm, NOSQ, board->en_passant_sq, false, board->fifty_move + 1, board->fifty_move, noc);
-                        mi++;
-                    } else if(board->square[sq + 1] > no) {
-                        t_cp = board->castle_perm;
-                        BITOFF(t_cp, bkc);
-                        BITOFF(t_cp, bqc);
-                        chess_move_set(&movelist[mi], sq, sq + 1, board->square[sq + 1], no, t_cp, board->castle_perm, NOSQ, board->en_passant_sq, false, 0, board->fifty_move, noc);
-                        mi++;
-                    }
-                    if(chess_rank_of(sq) > r_1) {
-                        if(board->square[sq - 7] == no) {
-                            t_cp = board->castle_perm;
-                            BITOFF(t_cp, bkc);
-                            BITOFF(t_cp, bqc);
-                            chess_move_set(&movelist[mi], sq, sq - 7, no, no, t_cp, board->castle_perm, NOSQ, board->en_passant_sq, false, board->fifty_move + 1, board->fifty_move, noc);
-                            mi++;
-                        } else if(board->square[sq - 7] > no) {
-                            t_cp = board->castle_perm;
-                            BITOFF(t_cp, bkc);
-                            BITOFF(t_cp, bqc);
-                            chess_move_set(&movelist[mi], sq, sq - 7, board->square[sq - 7], no, t_cp, board->castle_perm, NOSQ, board->en_passant_sq, false, 0, board->fifty_move, noc);
-                            mi++;
-                        }
-                    } else if(chess_rank_of(sq) < r_8) {
-                        if(board->square[sq + 9] == no) {
-                            t_cp = board->castle_perm;
-                            BITOFF(t_cp, bkc);
-                            BITOFF(t_cp, bqc);
-                            chess_move_set(&movelist[mi], sq, sq + 9, no, no, t_cp, board->castle_perm, NOSQ, board->en_passant_sq, false, board->fifty_move + 1, board->fifty_move, noc);
-                            mi++;
-                        } else if(board->square[sq + 9] > no) {
-                            t_cp = board->castle_perm;
-                            chess_move_set(&movelist[mi], sq, sq + 9, board->square[sq + 9], no, t_cp, board->castle_perm, NOSQ, board->en_passant_sq, false, 0, board->fifty_move, noc);
-                            mi++;
-                        }
-                    }
-                }
-                break;
-            }
-            default: {
-                fprintf(stderr, "ERROR: Expected -6 <= i <= 6, but got i = %zu at sq = %lu\n", piece, sq);
-                exit(1);
-            }
-        }
-        sq++;
-    }
-}
-bool chess_board_is_check(board_t *board, enum color stm) {
-    int64_t r, f, sq;
-    int64_t off = 0;
-    int64_t dir = 0;
-    if(stm == c_w) {
-        sq = board->white_king_sq;
-        r = chess_rank_of(sq);
-        f = chess_file_of(sq);
-        dir = 1;
-        off = dir;
-        while(sq + off < BOARDTOP && chess_file_of(sq + off) != f_a) {
-            if((board->square[sq + off] == br) || (board->square[sq + off] == bq)) {
-                return(true);
-            } else if(board->square[sq + off] == no) {
-                off += dir;
-                continue;
-            } else {
-                break;
-            }
-            off += dir;
-        }
-        dir = 8;
-        off = dir;
-        while(sq + off < BOARDTOP) {
-            if((board->square[sq + off] == br) || (board->square[sq + off] == bq)) {
-                return(true);
-            } else if(board->square[sq + off] == no) {
-                off += dir;
-                continue;
-            } else {
-                break;
-            }
-            off += dir;
-        }
-        dir =-1;
-        off = dir;
-        while(sq + off > BOARDBOTTOM && chess_file_of(sq + off) != f_h) {
-            if((board->square[sq + off] == br) || (board->square[sq + off] == bq)) {
-                return(true);
-            } else if(board->square[sq + off] == no) {
-                off += dir;
-                continue;
-            } else {
-                break;
-            }
-            off += dir;
-        }
-        dir = -8;
-        off = dir;
-        while(sq + off > BOARDBOTTOM) {
-            if((board->square[sq + off] == br) || (board->square[sq + off] == bq)) {
-                return(true);
-            } else if(board->square[sq + off] == no) {
-                off += dir;
-                continue;
-            } else {
-                break;
-            }
-            off += dir;
-        }
-        dir = 9;
-        off = dir;
-        while(sq + off < BOARDTOP && chess_file_of(sq + off) != f_a) {
-            if((board->square[sq + off] == bb) || (board->square[sq + off] == bq)) {
-                return(true);
-            } else if(board->square[sq + off] == no) {
-                off += dir;
-                continue;
-            } else {
-                break;
-            }
-            off += dir;
-        }
-        dir = 7;
-        off = dir;
-        while(sq + off < BOARDTOP && chess_file_of(sq + off) != f_h) {
-            if((board->square[sq + off] == bb) || (board->square[sq + off] == bq)) {
-                return(true);
-            } else if(board->square[sq + off] == no) {
-                off += dir;
-                continue;
-            } else {
-                break;
-            }
-            off += dir;
-        }
-        dir =-9;
-        off = dir;
-        while(sq + off > BOARDBOTTOM && chess_file_of(sq + off) != f_h) {
-            if((board->square[sq + off] == bb) || (board->square[sq + off] == bq)) {
-                return(true);
-            } else if(board->square[sq + off] == no) {
-                off += dir;
-                continue;
-            } else {
-                break;
-            }
-            off += dir;
-        }
-        dir =-7;
-        off = dir;
-        while(sq + off > BOARDBOTTOM && chess_file_of(sq + off) != f_a) {
-            if((board->square[sq + off] == bb) || (board->square[sq + off] == bq)) {
-                return(true);
-            } else if(board->square[sq + off] == no) {
-                off += dir;
-                continue;
-            } else {
-                break;
-            }
-            off += dir;
-        }
-        if(r > r_1) {
-            if(board->square[sq - 8] == bk) {return(true);}
-        }
-        if(r < r_8) {
-            if(board->square[sq + 8] == bk) {return(true);}
-        }
-        if(f > f_a) {
-            if(board->square[sq - 1] == bk) {return(true);}
-            if(board->square[sq + 7] == bp) {return(true);}
-            if(r > r_1) {
-                if(board->square[sq - 9] == bk) {return(true);}
-            }
-            if(r < r_8) {
-                if(board->square[sq + 7] == bk) {return(true);}
-            }
-            if(r > r_2) {
-                if(board->square[sq - 17] == bn) {return(true);}
-            }
-            if(r < r_7) {
-                if(board->square[sq + 15] == bn) {return(true);}
-            }
-        }
-        if(f < f_h) {
-            if(board->square[sq + 1] == bk) {return(true);}
-            if(board->square[sq + 9] == bp) {return(true);}
-            if(r > r_1) {
-                if(board->square[sq - 7] == bk) {return(true);}
-            }
-            if(r < r_8) {
-                if(board->square[sq + 9] == bk) {return(true);}
-            }
-            if(r > r_2) {
-                if(board->square[sq - 15] == bn) {return(true);}
-            }
-            if(r < r_7) {
-                if(board->square[sq + 17] == bn) {return(true);}
-            }
-        }
-        if(f > f_b) {
-            if(r > r_1) {
-                if(board->square[sq - 10] == bn) {return(true);}
-            }
-            if(r < r_8) {
-                if(board->square[sq + 6] == bn) {return(true);}
-            }
-        }
-        if(f < f_g) {
-            if(r > r_1) {
-                if(board->square[sq - 6] == bn) {return(true);}
-            }
-            if(r < r_8) {
-                if(board->square[sq + 10] == bn) {return(true);}
-            }
-        }
-    } else if(stm == c_b) {
-        sq = board->black_king_sq;
-        r = chess_rank_of(sq);
-        f = chess_file_of(sq);
-        dir = 1;
-        off = dir;
-        while(sq + off < BOARDTOP && chess_file_of(sq + off) != f_a) {
-            if((board->square[sq + off] == wr) || (board->square[sq + off] == wq)) {
-                return(true);
-            } else if(board->square[sq + off] == no) {
-                off += dir;
-                continue;
-            } else {
-                break;
-            }
-            off += dir;
-        }
-        dir = 8;
-        off = dir;
-        while(sq + off < BOARDTOP) {
-            if((board->square[sq + off] == wr) || (board->square[sq + off] == wq)) {
-                return(true);
-            } else if(board->square[sq + off] == no) {
-                off += dir;
-                continue;
-            } else {
-                break;
-            }
-            off += dir;
-        }
-        dir =-1;
-        off = dir;
-        while(sq + off > BOARDBOTTOM && chess_file_of(sq + off) != f_h) {
-            if((board->square[sq + off] == wr) || (board->square[sq + off] == wq)) {
-                return(true);
-            } else if(board->square[sq + off] == no) {
-                off += dir;
-                continue;
-            } else {
-                break;
-            }
-            off += dir;
-        }
-        dir = -8;
-        off = dir;
-        while(sq + off > BOARDBOTTOM) {
-            if((board->square[sq + off] == wr) || (board->square[sq + off] == wq)) {
-                return(true);
-            } else if(board->square[sq + off] == no) {
-                off += dir;
-                continue;
-            } else {
-                break;
-            }
-            off += dir;
-        }
-        dir = 9;
-        off = dir;
-        while(sq + off < BOARDTOP && chess_file_of(sq + off) != f_a) {
-            if((board->square[sq + off] == wb) || (board->square[sq + off] == wq)) {
-                return(true);
-            } else if(board->square[sq + off] == no) {
-                off += dir;
-                continue;
-            } else {
-                break;
-            }
-            off += dir;
-        }
-        dir = 7;
-        off = dir;
-        while(sq + off < BOARDTOP && chess_file_of(sq + off) != f_h) {
-            if((board->square[sq + off] == wb) || (board->square[sq + off] == wq)) {
-                return(true);
-            } else if(board->square[sq + off] == no) {
-                off += dir;
-                continue;
-            } else {
-                break;
-            }
-            off += dir;
-        }
-        dir =-9;
-        off = dir;
-        while(sq + off > BOARDBOTTOM && chess_file_of(sq + off) != f_h) {
-            if((board->square[sq + off] == wb) || (board->square[sq + off] == wq)) {
-                return(true);
-            } else if(board->square[sq + off] == no) {
-                off += dir;
-                continue;
-            } else {
-                break;
-            }
-            off += dir;
-        }
-        dir =-7;
-        off = dir;
-        while(sq + off > BOARDBOTTOM && chess_file_of(sq + off) != f_a) {
-            if((board->square[sq + off] == wb) || (board->square[sq + off] == wq)) {
-                return(true);
-            } else if(board->square[sq + off] == no) {
-                off += dir;
-                continue;
-            } else {
-                break;
-            }
-            off += dir;
-        }
-        if(r > r_1) {
-            if(board->square[sq - 8] == wk) {return(true);}
-        }
-        if(r < r_8) {
-            if(board->square[sq + 8] == wk) {return(true);}
-        }
-        if(f > f_a) {
-            if(board->square[sq - 1] == wk) {return(true);}
-            if(board->square[sq - 9] == wp) {return(true);}
-            if(r > r_1) {
-                if(board->square[sq - 9] == wk) {return(true);}
-            }
-            if(r < r_8) {
-                if(board->square[sq + 7] == wk) {return(true);}
-            }
-            if(r > r_2) {
-                if(board->square[sq - 17] == wn) {return(true);}
-            }
-            if(r < r_7) {
-                if(board->square[sq + 15] == wn) {return(true);}
-            }
-        }
-        if(f < f_h) {
-            if(board->square[sq + 1] == wk) {return(true);}
-            if(board->square[sq - 7] == wp) {return(true);}
-            if(r > r_1) {
-                if(board->square[sq - 7] == wk) {return(true);}
-            }
-            if(r < r_8) {
-                if(board->square[sq + 9] == wk) {return(true);}
-            }
-            if(r > r_2) {
-                if(board->square[sq - 15] == wn) {return(true);}
-            }
-            if(r < r_7) {
-                if(board->square[sq + 17] == wn) {return(true);}
-            }
-        }
-        if(f > f_b) {
-            if(r > r_1) {
-                if(board->square[sq - 10] == wn) {return(true);}
-            }
-            if(r < r_8) {
-                if(board->square[sq + 6] == wn) {return(true);}
-            }
-        }
-        if(f < f_g) {
-            if(r > r_1) {
-                if(board->square[sq - 6] == wn) {return(true);}
-            }
-            if(r < r_8) {
-                if(board->square[sq + 10] == wn) {return(true);}
-            }
-        }
-    } else {
-        fprintf(stderr, "ERROR: Unexpected color in Is_check: %d\n", stm);
-        exit(1);
-    }
-    return(false);
-}
-void chess_board_legal_moves(board_t *board, move_t *temp, enum color stm) {
-    /*
-     * I meassured that it does 1.2e6 iterations per second, which is like a 40x speedup
-     * I missed something major and don't even know what. FUCK!!!! FUCK!!!!
-     * Turns out I did miss reseting b->ml and not just t... I am such a dumbazz
-     */
-    chess_movelist_reset(board->movelist);
-    chess_board_pseudolegal_moves(board, temp, stm);
-    int64_t c = chess_movelist_count(temp);
-    int64_t mli = 0;
-    for(int64_t i = 0; i < c; i++) {
-        chess_make_move(board, &temp[i]);
-        if(!chess_board_is_check(board, stm)) {
-            board->movelist[mli] = temp[i];
-            mli++;
-        }
-        chess_undo_move(board, &temp[i]);
-    }
-}
-enum color chess_board_score(board_t *board) {
-    // Requires b_lm to have been called before so that b->ml has the legal moves in it and they don't need to be computed again for performance reasons
-    if(chess_movelist_count(board->movelist) == 0) {
-        if(chess_board_is_check(board, board->stm)) {
-#ifdef CHESS_PRINT_GAME_RESULTS
-            if(board->stm == c_b) {
-                printf("RESULT: 1.0/0.0 = White won by checkmate\n");
-            } else {
-                printf("RESULT: 0.0/1.0 = Black won by checkmate\n");
+        }
+    }
+    targets = chess_pawn_attacks[CHESS_COLOR_INDEX(us)][sq];
+    while(targets) {
+        if(board->square[chess_pop_lsb(&targets)] == -us * wp) {return(true);}
+    }
+    targets = chess_knight_attacks[sq];
+    while(targets) {
+        if(board->square[chess_pop_lsb(&targets)] == -us * wn) {return(true);}
+    }
+    return(false);
+}
+#define CHESS_INSTANTIATE_FOR_COLOR(suffix, color) \
+    static void chess_board_pseudolegal_moves_##suffix(board_t *board, move_t *movelist) { \
+        chess_board_pseudolegal_moves_generic(board, movelist, color); \
+    } \
+    static bool chess_board_is_check_##suffix(board_t *board) { \
+        return(chess_board_is_check_generic(board, color)); \
+    }
+CHESS_INSTANTIATE_FOR_COLOR(white, c_w)
+CHESS_INSTANTIATE_FOR_COLOR(black, c_b)
+
+void chess_board_pseudolegal_moves(board_t *board, move_t *movelist, enum color stm) {
+    // This does about ~3e6 per second
+    if(stm == c_w) {
+        chess_board_pseudolegal_moves_white(board, movelist);
+    } else if(stm == c_b) {
+        chess_board_pseudolegal_moves_black(board, movelist);
+    } else {
+        fprintf(stderr, "ERROR: Unexpected color in pseudolegal_moves: %d\n", stm);
+        exit(1);
+    }
+}
+bool chess_board_is_check(board_t *board, enum color stm) {
+    if(stm == c_w) {
+        return(chess_board_is_check_white(board));
+    } else if(stm == c_b) {
+        return(chess_board_is_check_black(board));
+    }
+    fprintf(stderr, "ERROR: Unexpected color in Is_check: %d\n", stm);
+    exit(1);
+}
+void chess_board_legal_moves(board_t *board, move_t *temp, enum color stm) {
+    /*
+     * I meassured that it does 1.2e6 iterations per second, which is like a 40x speedup
+     * I missed something major and don't even know what. FUCK!!!! FUCK!!!!
+     * Turns out I did miss reseting b->ml and not just t... I am such a dumbazz
+     */
+    chess_movelist_reset(board->movelist);
+    chess_board_pseudolegal_moves(board, temp, stm);
+    // These moves are only made to test for check, an attached accumulator would pay a push and a pop for each of them for nothing
+    accumulator_t *accumulator = board->accumulator;
+    board->accumulator = NULL;
+    int64_t c = chess_movelist_count(temp);
+    int64_t mli = 0;
+    for(int64_t i = 0; i < c; i++) {
+        chess_make_move(board, &temp[i]);
+        if(!chess_board_is_check(board, stm)) {
+            board->movelist[mli] = temp[i];
+            mli++;
+        }
+        chess_undo_move(board, &temp[i]);
+    }
+    board->accumulator = accumulator;
+}
+enum color chess_board_result(board_t *board) {
+    // Same as b_score, but silent so that it can be used inside of searches
+    if(chess_movelist_count(board->movelist) == 0) {
+        return(chess_board_is_check(board, board->stm) ? -board->stm : c_d);
+    }
+    if(board->fifty_move == 50) {
+        return(c_d);
+    }
+    return(c_e);
+}
+enum color chess_board_score(board_t *board) {
+    // Requires b_lm to have been called before so that b->ml has the legal moves in it and they don't need to be computed again for performance reasons
+    if(chess_movelist_count(board->movelist) == 0) {
+        if(chess_board_is_check(board, board->stm)) {
+#ifdef CHESS_PRINT_GAME_RESULTS
+            if(board->stm == c_b) {
+                printf("RESULT: 1.0/0.0 = White won by checkmate\n");
+            } else {
+                printf("RESULT: 0.0/1.0 = Black won by checkmate\n");
             }
 #endif
             return(-board->stm); // The side to move is in check and has no legal moves, so the opponent wins
@@ -2143,26 +829,159 @@ enum color chess_play_random_game(board_t *board, move_t *temp) {
     }
     return(score);
 }
-int64_t chess_moveindex_from_ai(board_t *board, neuralnet_t *net) {
+#undef r
+uint64_t chess_rand(uint64_t *state) {
+    // xorshift64*, so that every thread can keep its own random stream instead of sharing rand()
+    *state ^= *state >> 12;
+    *state ^= *state << 25;
+    *state ^= *state >> 27;
+    return(*state * 0x2545F4914F6CDD1DULL);
+}
+enum color chess_board_random_move(board_t *board, move_t *temp, uint64_t *rng) {
     /*
-     * Requires legalmoves to be in board->movelist
+     * Plays one random legal move without printing anything. Returns c_e if the game goes on and the result if it was already over.
+     * Searches call this in a loop instead of b_playout when they need to be able to bail out in between moves
      */
-    int64_t count = chess_movelist_count(board->movelist);
-    int64_t movelist_i = -1;
-    long double best_val = INT32_MAX * -board->stm; // INT32_MAX has no special property it is just a random relatively big number
-    for(int64_t i = 0; i < count; i++) {
-        chess_make_move(board, &board->movelist[i]);
+    chess_board_legal_moves(board, temp, board->stm);
+    enum color result = chess_board_result(board);
+    if(result != c_e) {
+        return(result);
+    }
+    chess_make_move(board, &board->movelist[chess_rand(rng) % chess_movelist_count(board->movelist)]);
+    board->stm = -board->stm;
+    return(c_e);
+}
+enum color chess_board_playout(board_t *board, move_t *temp, uint64_t *rng, int64_t max_plies) {
+    /*
+     * Plays random moves until the game is over and leaves board in the final position. Games that take longer than max_plies are counted as draws
+     */
+    enum color result;
+    for(int64_t ply = 0; ply < max_plies; ply++) {
+        result = chess_board_random_move(board, temp, rng);
+        if(result != c_e) {
+            return(result);
+        }
+    }
+    return(c_d);
+}
+void chess_board_features(board_t *board, nn_sparse_t *sparse) {
+    // The active features of the position for neuralnet_forward_sparse, one per piece on the board
+    sparse->count = 0;
+    for(int64_t sq = 0; sq < BOARDTOP; sq++) {
+        if(board->square[sq] != no) {
+            assert(sparse->count < NN_SPARSE_MAX);
+            sparse->features[sparse->count++] = CHESS_FEATURE(board->square[sq], sq);
+        }
+    }
+}
+void chess_board_attach(board_t *board, accumulator_t *accumulator) {
+    /*
+     * From here on chess_make_move and chess_undo_move keep accumulator in sync with board, which has to be in the position it should start from.
+     * Moves have to be undone in reverse order, a board that only ever plays forward like a playout would overflow it. NULL detaches
+     */
+    board->accumulator = accumulator;
+    if(accumulator != NULL) {
+        nn_sparse_t features;
+        chess_board_features(board, &features);
+        accumulator_refresh(accumulator, &features);
+    }
+}
+void chess_board_encode(board_t *board, neuralnet_t *net, int64_t row, nn_sparse_t *features) {
+    /*
+     * Writes board into one row of the input of net. A net with CHESS_FEATURES inputs takes the one hot encoding, which goes into features[row] instead,
+     * any other one the 64 raw squares. chess_net_forward then runs whichever of the two it is
+     */
+    if(NN_INPUT(*net).columns == CHESS_FEATURES) {
+        chess_board_features(board, &features[row]);
+    } else {
         for(int64_t j = 0; j < BOARDTOP; j++) {
-            MATRIX_AT(net->activations[0], 0, j) = board->square[j];
+            MATRIX_AT(NN_INPUT(*net), row, j) = board->square[j];
         }
-        neuralnet_forward(*net);;
-        chess_undo_move(board, &board->movelist[i]);
     }
-    if(movelist_i == -1) {
+}
+void chess_net_forward(neuralnet_t *net, nn_sparse_t *features, int64_t rows) {
+    // Forward pass over the first rows positions written by chess_board_encode
+    if(NN_INPUT(*net).columns == CHESS_FEATURES) {
+        neuralnet_forward_sparse(*net, features, rows);
+    } else {
+        neuralnet_forward_rows(*net, rows);
+    }
+}
+int64_t chess_moveindex_from_ai(board_t *board, neuralnet_t *net) {
+    /*
+     * Requires legalmoves to be in board->movelist. Every child position goes into one row of the input and all of them are scored in a single batched
+     * forward pass, so net should be a neuralnet_batch with room for a whole movelist, smaller ones work in several passes. See chess_board_encode for the inputs.
+     * If an accumulator of net is attached to board, the first layer of every child is the one of board plus a few rows instead of a whole sparse first layer.
+     * The first output is whites score like in mcts_evaluate_neuralnet, so white picks the highest and black the lowest
+     */
+    int64_t count = chess_movelist_count(board->movelist);
+    if(count == 0) {
+        fprintf(stderr, "ERROR: chess_moveindex_from_ai called without legal moves\n");
         exit(1);
     }
+    accumulator_t *accumulator = board->accumulator;
+    assert(accumulator == NULL || accumulator->net.parameters == net->parameters);
+    int64_t capacity = NN_INPUT(*net).rows;
+    nn_sparse_t features[MAXM];
+    nn_scalar_t scores[MAXM];
+    for(int64_t first = 0; first < count; first += capacity) {
+        int64_t rows = count - first < capacity ? count - first : capacity;
+        for(int64_t i = 0; i < rows; i++) {
+            chess_make_move(board, &board->movelist[first + i]);
+            if(accumulator != NULL) {
+                accumulator_store(accumulator, *net, i);
+            } else {
+                chess_board_encode(board, net, i, features);
+            }
+            chess_undo_move(board, &board->movelist[first + i]);
+        }
+        if(accumulator != NULL) {
+            neuralnet_forward_hidden(*net, rows);
+        } else {
+            chess_net_forward(net, features, rows);
+        }
+        for(int64_t i = 0; i < rows; i++) {
+            scores[first + i] = MATRIX_AT(NN_OUTPUT(*net), i, 0) * board->stm;
+        }
+    }
+    int64_t movelist_i = 0;
+    nn_scalar_t best_val = scores[0];
+    for(int64_t i = 1; i < count; i++) {
+        movelist_i = scores[i] > best_val ? i : movelist_i;
+        best_val = scores[i] > best_val ? scores[i] : best_val;
+    }
     return(movelist_i);
 }
 enum color chess_play_ai_game(board_t *board, neuralnet_t *net1, neuralnet_t *net2, move_t *temp) {
-    return(c_e);
+    /*
+     * net1 plays white and net2 black from the position on board until the game is over, board is left in the final position.
+     * Without repetition detection two deterministic nets can shuffle pieces forever, so games longer than CHESS_AI_GAME_MAX_PLIES are drawn.
+     * Both nets should be batches with room for a whole movelist, see chess_moveindex_from_ai.
+     * A net with CHESS_FEATURES inputs gets an accumulator, attached only while it picks a move so that the moves of the game itself don't fill it up
+     */
+    accumulator_t *accumulators[2] = {NULL, NULL}; // Indexed by CHESS_COLOR_INDEX
+    if(NN_INPUT(*net2).columns == CHESS_FEATURES) {
+        accumulators[CHESS_COLOR_INDEX(c_b)] = accumulator_alloc(*net2, 1);
+    }
+    if(NN_INPUT(*net1).columns == CHESS_FEATURES) {
+        accumulators[CHESS_COLOR_INDEX(c_w)] = accumulator_alloc(*net1, 1);
+    }
+    enum color result = c_e;
+    for(int64_t ply = 0; result == c_e && ply < CHESS_AI_GAME_MAX_PLIES; ply++) {
+        chess_board_legal_moves(board, temp, board->stm);
+        result = chess_board_result(board);
+        if(result == c_e) {
+            chess_board_attach(board, accumulators[CHESS_COLOR_INDEX(board->stm)]);
+            int64_t index = chess_moveindex_from_ai(board, board->stm == c_w ? net1 : net2);
+            chess_board_attach(board, NULL);
+            chess_make_move(board, &board->movelist[index]);
+            board->stm = -board->stm;
+        }
+    }
+    for(int64_t i = 0; i < 2; i++) {
+        if(accumulators[i] != NULL) {
+            accumulator_free(accumulators[i]);
+        }
+    }
+    return(result == c_e ? c_d : result);
 }
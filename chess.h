@@ -12,12 +12,20 @@
 #define MAXM 219 
 // Not sure wether this only applies to chess positions reachable from the standard starting positition
 #define NOSQ 64
+#define CHESS_STARTPOS "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1"
+#define CHESS_AI_GAME_MAX_PLIES 512
 
 #define BITOFF(cp, c) ((cp) ^= (cp) & (1) << (c - 1))
 #define BITON(cp, c) ((cp) |= (1) << (c - 1))
 #define BITTOGGLE(cp, c) (cp ^= (1) << (c - 1))
 #define BITVAL(cp, c) ((cp) &= (1) << (c - 1))
 
+#define CHESS_BIT(sq) ((uint64_t) 1 << (sq))
+#define CHESS_COLOR_INDEX(c) (((c) + 1) >> 1) // c_b -> 0, c_w -> 1
+// One hot board encoding for a neural net, one feature per piece and square. White pieces come first, wp on a1 is 0 and bk on h8 is 767
+#define CHESS_FEATURES 768
+#define CHESS_FEATURE(piece, sq) ((((piece) > 0 ? (piece) - 1 : 5 - (piece)) << 6) + (sq))
+
 enum color {
     c_b = -1, c_d = 0, c_w = 1, c_e = 2,
 };
@@ -86,8 +94,22 @@ typedef struct {
     int64_t fifty_move; 
     int64_t past_moves; 
     int64_t castle_perm;
+    accumulator_t *accumulator; // NULL unless a net evaluates this board incrementally, see chess_board_attach
 } board_t;
 
+extern uint64_t chess_knight_attacks[BOARDTOP];
+extern uint64_t chess_king_attacks[BOARDTOP];
+extern uint64_t chess_pawn_attacks[2][BOARDTOP]; // Squares a pawn of color CHESS_COLOR_INDEX(c) on sq attacks
+extern uint8_t chess_ray_length[BOARDTOP][8]; // Amount of squares until the edge of the board in each direction
+extern const int64_t chess_direction_offset[8];
+
+static inline int64_t chess_pop_lsb(uint64_t *bb) {
+    int64_t sq = __builtin_ctzll(*bb);
+    *bb &= *bb - 1;
+    return(sq);
+}
+
+extern void chess_tables_init(void);
 extern int64_t chess_rank_of(int64_t square); 
 extern int64_t chess_file_of(int64_t square); 
 extern int64_t chess_piece_value(const char name); 
@@ -96,6 +118,7 @@ extern void chess_name_of(int64_t square, char name[3]);
 extern move_t chess_move_alloc(void); 
 extern void chess_move_print(move_t move); 
 extern inline void chess_move_set(move_t *move, int64_t from_sq, int64_t to_sq, enum pieces captured_piece, enum pieces promoted_piece, int64_t castle_perm, int64_t past_castle_perm, int64_t en_passant_sq, int64_t past_en_passant_sq, bool is_en_passant, int64_t fifty_move, int64_t past_fifty_move, enum castle is_castle); 
+extern void chess_move_name(move_t move, char name[6]);
 extern void chess_move_reset(move_t *move);
 extern bool chess_move_is_empty(move_t *move); 
 
@@ -106,16 +129,25 @@ extern void chess_movelist_dump(move_t *movelist);
 
 extern board_t chess_board_alloc(void); 
 extern void chess_board_read_fen(board_t *board, const char *fen); 
+extern void chess_board_copy(board_t *destination, board_t *source);
 extern void chess_board_print(board_t board); 
 extern void chess_make_move(board_t *board, move_t *move); 
 extern void chess_undo_move(board_t *board, move_t *move); 
 extern bool chess_board_is_check(board_t *board, enum color stm);
 extern void chess_board_pseudolegal_moves(board_t *board, move_t *movelist, enum color stm); 
 extern void chess_board_legal_moves(board_t *board, move_t *temp, enum color stm); 
+extern enum color chess_board_result(board_t *board);
 extern enum color chess_board_score(board_t *board); 
 extern enum color chess_play_random_game(board_t *board, move_t *temp); 
+extern uint64_t chess_rand(uint64_t *state);
+extern enum color chess_board_random_move(board_t *board, move_t *temp, uint64_t *rng);
+extern enum color chess_board_playout(board_t *board, move_t *temp, uint64_t *rng, int64_t max_plies);
 
+extern void chess_board_features(board_t *board, nn_sparse_t *sparse);
+extern void chess_board_attach(board_t *board, accumulator_t *accumulator);
+extern void chess_board_encode(board_t *board, neuralnet_t *net, int64_t row, nn_sparse_t *features);
+extern void chess_net_forward(neuralnet_t *net, nn_sparse_t *features, int64_t rows);
 extern int64_t chess_moveindex_from_ai(board_t *board, neuralnet_t *net); // Returns the index of the move the ai wants to play
-extern enum color chess_play_ai_game(board_t *board, neuralnet_t *net1, neuralnet_t *net2, move_t *temp); 
+extern enum color chess_play_ai_game(board_t *board, neuralnet_t *net1, neuralnet_t *net2, move_t *temp); // Returns the result of net1 as white against net2 as black
 
 #endif
@@ -0,0 +1,168 @@
+#include "evolve.h"
+#include "arena.h"
+#include "chess.h"
+#include "nn.h"
+#include <assert.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+static void evolve_work(evolve_worker_t *worker) {
+    /*
+     * Members are handed out one at a time instead of in fixed slices, fitness by games takes very different amounts of time per member
+     */
+    evolve_t *evolve = worker->evolve;
+    for(;;) {
+        int64_t member = atomic_fetch_add(&evolve->next_member, 1);
+        if(member >= 2 * evolve->pairs) {
+            break;
+        }
+        neuralnet_perturb(worker->member, evolve->net, evolve->seeds[member / 2], member % 2 == 0 ? evolve->sigma : -evolve->sigma);
+        evolve->scores[member] = evolve->fitness(worker->context, worker->member);
+    }
+}
+static void *evolve_thread(void *argument) {
+    evolve_worker_t *worker = argument;
+    evolve_t *evolve = worker->evolve;
+    while(true) {
+        // Parked here between generations like the workers of train_t
+        pthread_barrier_wait(&evolve->barrier);
+        if(evolve->quit) {
+            break;
+        }
+        evolve_work(worker);
+        pthread_barrier_wait(&evolve->barrier);
+    }
+    return(NULL);
+}
+evolve_t *evolve_alloc(neuralnet_t net, int64_t pairs, double sigma, double rate, int64_t thread_count, evolve_fitness_fn fitness, void **contexts) {
+    /*
+     * Evolution strategies with antithetic sampling: a population of 2 * pairs members around net, which is updated in place by every evolve_step.
+     * contexts has one entry per thread which is handed to fitness, it may be NULL for fitness functions that don't need one
+     */
+    assert(thread_count > 0 && thread_count <= EVOLVE_THREADS_MAX);
+    assert(pairs > 0);
+    assert(net.mapping == NULL);
+    evolve_t *evolve = calloc(1, sizeof(*evolve));
+    assert(evolve != NULL);
+    evolve->net = net;
+    evolve->pairs = pairs;
+    evolve->sigma = sigma;
+    evolve->rate = rate;
+    evolve->fitness = fitness;
+    evolve->thread_count = thread_count;
+    evolve->seeds = malloc(sizeof(*evolve->seeds) * pairs);
+    evolve->scores = malloc(sizeof(*evolve->scores) * 2 * pairs);
+    assert(evolve->seeds != NULL);
+    assert(evolve->scores != NULL);
+    if(pthread_barrier_init(&evolve->barrier, NULL, thread_count) != 0) {
+        fprintf(stderr, "ERROR: Could not create the evolution barrier\n");
+        exit(1);
+    }
+    for(int64_t i = 0; i < thread_count; i++) {
+        evolve->workers[i].evolve = evolve;
+        evolve->workers[i].index = i;
+        evolve->workers[i].member = neuralnet_clone(net);
+        evolve->workers[i].context = contexts == NULL ? NULL : contexts[i];
+    }
+    for(int64_t i = 1; i < thread_count; i++) {
+        if(pthread_create(&evolve->threads[i], NULL, evolve_thread, &evolve->workers[i]) != 0) {
+            fprintf(stderr, "ERROR: Could not start evolution worker %ld\n", i);
+            exit(1);
+        }
+    }
+    return(evolve);
+}
+void evolve_free(evolve_t *evolve) {
+    evolve->quit = true;
+    if(evolve->thread_count > 1) {
+        pthread_barrier_wait(&evolve->barrier);
+    }
+    for(int64_t i = 1; i < evolve->thread_count; i++) {
+        pthread_join(evolve->threads[i], NULL);
+    }
+    for(int64_t i = 0; i < evolve->thread_count; i++) {
+        neuralnet_free(evolve->workers[i].member);
+    }
+    pthread_barrier_destroy(&evolve->barrier);
+    free(evolve->seeds);
+    free(evolve->scores);
+    free(evolve);
+}
+static uint64_t evolve_seed(uint64_t seed, int64_t pair) {
+    // Distinct and well mixed seeds for every pair of every generation, chess_rand of a state that is never 0
+    uint64_t state = (seed + 1) * 0x9E3779B97F4A7C15ULL + pair * 0xD1B54A32D192ED03ULL;
+    state = state != 0 ? state : 1;
+    return(chess_rand(&state));
+}
+double evolve_step(evolve_t *evolve, uint64_t seed) {
+    /*
+     * One generation, seed picks its noise. Selection and recombination in one: every member gets a centered rank in [-0.5, 0.5], and the parent moves
+     * along the noise of every pair weighted by how much better its plus member ranked than its minus member. Ranks instead of raw fitness make the step
+     * size independent of the scale of the fitness. The noise is regenerated from the seeds for the update, nothing the size of a net is stored per member.
+     * Returns the best fitness of the generation
+     */
+    int64_t members = 2 * evolve->pairs;
+    for(int64_t i = 0; i < evolve->pairs; i++) {
+        evolve->seeds[i] = evolve_seed(seed, i);
+    }
+    atomic_store(&evolve->next_member, 0);
+    if(evolve->thread_count > 1) {
+        pthread_barrier_wait(&evolve->barrier);
+    }
+    evolve_work(&evolve->workers[0]);
+    if(evolve->thread_count > 1) {
+        pthread_barrier_wait(&evolve->barrier);
+    }
+
+    double best = evolve->scores[0];
+    double *ranks = malloc(sizeof(*ranks) * members);
+    assert(ranks != NULL);
+    for(int64_t i = 0; i < members; i++) {
+        // Ties share the mean of their ranks, so that identical members cancel out exactly
+        int64_t below = 0;
+        int64_t equal = 0;
+        for(int64_t j = 0; j < members; j++) {
+            below += evolve->scores[j] < evolve->scores[i];
+            equal += evolve->scores[j] == evolve->scores[i];
+        }
+        ranks[i] = (below + (equal - 1) / 2.0) / (members > 1 ? members - 1 : 1) - 0.5;
+        best = evolve->scores[i] > best ? evolve->scores[i] : best;
+    }
+    for(int64_t i = 0; i < evolve->pairs; i++) {
+        double weight = ranks[2 * i] - ranks[2 * i + 1];
+        if(weight != 0) {
+            neuralnet_perturb(evolve->net, evolve->net, evolve->seeds[i], evolve->rate * weight / (members * evolve->sigma));
+        }
+    }
+    free(ranks);
+    return(best);
+}
+double evolve_fitness_cost(void *context, neuralnet_t net) {
+    evolve_cost_t *cost = context;
+    return(-neuralnet_cost(net, cost->input, cost->output));
+}
+double evolve_fitness_games(void *context, neuralnet_t net) {
+    /*
+     * Every member plays the same openings, seeded by the context, so that they are compared on the same positions
+     */
+    evolve_games_t *games = context;
+    neuralnet_t batch = neuralnet_batch(net, MAXM);
+    double score = 0;
+    for(int64_t pair = 0; pair < games->pairs; pair++) {
+        for(int64_t color = 0; color < 2; color++) {
+            uint64_t rng = (games->seed + pair + 1) * 0x9E3779B97F4A7C15ULL;
+            arena_opening(&games->board, games->temp, &rng);
+            enum color result = color == 0 ? chess_play_ai_game(&games->board, &batch, &games->opponent, games->temp)
+                                            : chess_play_ai_game(&games->board, &games->opponent, &batch, games->temp);
+            enum color ours = color == 0 ? c_w : c_b;
+            score += result == ours ? 1 : (result == c_d ? 0.5 : 0);
+        }
+    }
+    neuralnet_batch_free(batch);
+    return(score);
+}
@@ -0,0 +1,63 @@
+#ifndef EVOLVE_H
+#define EVOLVE_H
+
+#include "chess.h"
+#include "nn.h"
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#define EVOLVE_THREADS_MAX 64
+
+// Higher is better. context is the one of the thread that evaluates, so it can hold scratch state
+typedef double (*evolve_fitness_fn)(void *context, neuralnet_t net);
+
+struct evolve;
+
+typedef struct {
+    struct evolve *evolve;
+    int64_t index;
+    neuralnet_t member; // Scratch net every member of the population this thread evaluates is perturbed into
+    void *context;
+} evolve_worker_t;
+
+typedef struct evolve {
+    neuralnet_t net; // The parent, every generation moves it towards the fitter members
+    int64_t pairs;
+    double sigma; // Standard deviation of the perturbations
+    double rate;
+    evolve_fitness_fn fitness;
+    int64_t thread_count;
+    evolve_worker_t workers[EVOLVE_THREADS_MAX];
+    pthread_t threads[EVOLVE_THREADS_MAX];
+    pthread_barrier_t barrier;
+    // One seed per antithetic pair instead of the noise itself, member 2i is parent + sigma * noise(seeds[i]) and member 2i + 1 parent - sigma * noise(seeds[i])
+    uint64_t *seeds;
+    double *scores; // Fitness of every member of the current generation
+    atomic_int_fast64_t next_member;
+    bool quit;
+} evolve_t;
+
+// Context of evolve_fitness_cost, fitness is minus the cost on the data set
+typedef struct {
+    matrix_t input;
+    matrix_t output;
+} evolve_cost_t;
+
+// Context of evolve_fitness_games, fitness is the score of paired games against opponent from random openings, 1 per win and 0.5 per draw
+typedef struct {
+    neuralnet_t opponent; // A batch of the opponent, see neuralnet_batch
+    int64_t pairs;
+    uint64_t seed;
+    board_t board;
+    move_t temp[MAXM];
+} evolve_games_t;
+
+extern evolve_t *evolve_alloc(neuralnet_t net, int64_t pairs, double sigma, double rate, int64_t thread_count, evolve_fitness_fn fitness, void **contexts);
+extern void evolve_free(evolve_t *evolve);
+extern double evolve_step(evolve_t *evolve, uint64_t seed);
+extern double evolve_fitness_cost(void *context, neuralnet_t net);
+extern double evolve_fitness_games(void *context, neuralnet_t net);
+
+#endif
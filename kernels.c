@@ -0,0 +1,533 @@
+#include "kernels.h"
+#include "nn.h"
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// The vector sets only exist for float on x86. They are compiled with target attributes instead of -m flags, so that one binary still starts on hosts without them
+#if (defined(__x86_64__) || defined(__i386__)) && !defined(NN_DOUBLE) && !defined(NN_LONG_DOUBLE)
+#define KERNELS_X86
+#include <immintrin.h>
+#define KERNELS_TARGET_AVX2 __attribute__((target("avx2,fma")))
+#define KERNELS_TARGET_AVX512 __attribute__((target("avx512f,avx2,fma")))
+#endif
+
+static void kernels_dot_store(nn_scalar_t *destination, uint64_t stride, uint64_t rows, uint64_t columns, bool accumulate,
+                              nn_scalar_t sum[NN_GEMM_MR][NN_GEMM_NR]) {
+    for (uint64_t r = 0; r < rows; r++) {
+        for (uint64_t c = 0; c < columns; c++) {
+            destination[r * stride + c] = accumulate ? destination[r * stride + c] + sum[r][c] : sum[r][c];
+        }
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// ---SCALAR---
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+static void kernels_dot_scalar(uint64_t depth, const nn_scalar_t *first, const nn_scalar_t *second, nn_scalar_t *destination, uint64_t stride,
+                               uint64_t rows, uint64_t columns, bool accumulate) {
+    nn_scalar_t sum[NN_GEMM_MR][NN_GEMM_NR];
+#ifdef NN_LONG_DOUBLE
+    memset(sum, 0, sizeof(sum));
+    for (uint64_t k = 0; k < depth; k++) {
+        for (uint64_t r = 0; r < NN_GEMM_MR; r++) {
+            for (uint64_t c = 0; c < NN_GEMM_NR; c++) {
+                sum[r][c] += first[k * NN_GEMM_MR + r] * second[k * NN_GEMM_NR + c];
+            }
+        }
+    }
+#else
+    // Portable, but written with vector types so that the accumulators stay in whatever registers the baseline target has (SSE2 on every x86-64).
+    // There are no vectors of long double, hence the plain loop above
+    typedef nn_scalar_t kernels_vector_t __attribute__((vector_size(16)));
+    enum { vectors = NN_GEMM_NR * sizeof(nn_scalar_t) / 16 };
+    kernels_vector_t vector[NN_GEMM_MR][vectors] = {0};
+    for (uint64_t k = 0; k < depth; k++) {
+        kernels_vector_t b[vectors];
+        memcpy(b, &second[k * NN_GEMM_NR], sizeof(b));
+        for (uint64_t r = 0; r < NN_GEMM_MR; r++) {
+            for (uint64_t v = 0; v < vectors; v++) {
+                vector[r][v] += first[k * NN_GEMM_MR + r] * b[v];
+            }
+        }
+    }
+    memcpy(sum, vector, sizeof(sum));
+#endif
+    kernels_dot_store(destination, stride, rows, columns, accumulate, sum);
+}
+static void kernels_add_scalar(nn_scalar_t *destination, const nn_scalar_t *first, uint64_t n) {
+    for (uint64_t i = 0; i < n; i++) {
+        destination[i] += first[i];
+    }
+}
+static void kernels_axpy_scalar(nn_scalar_t *destination, nn_scalar_t alpha, const nn_scalar_t *first, uint64_t n) {
+    for (uint64_t i = 0; i < n; i++) {
+        destination[i] += alpha * first[i];
+    }
+}
+static void kernels_scale_scalar(nn_scalar_t *destination, nn_scalar_t alpha, uint64_t n) {
+    for (uint64_t i = 0; i < n; i++) {
+        destination[i] *= alpha;
+    }
+}
+static void kernels_fill_scalar(nn_scalar_t *destination, nn_scalar_t filler, uint64_t n) {
+    for (uint64_t i = 0; i < n; i++) {
+        destination[i] = filler;
+    }
+}
+static void kernels_copy_scalar(nn_scalar_t *destination, const nn_scalar_t *first, uint64_t n) {
+    memmove(destination, first, sizeof(*destination) * n);
+}
+static void kernels_activate_scalar(nn_scalar_t *destination, uint64_t n) {
+    for (uint64_t i = 0; i < n; i++) {
+        destination[i] = ACTIVATE(destination[i]);
+    }
+}
+static void kernels_d_activate_scalar(nn_scalar_t *destination, const nn_scalar_t *first, uint64_t n) {
+    for (uint64_t i = 0; i < n; i++) {
+        destination[i] *= D_ACTIVATE(first[i]);
+    }
+}
+static void kernels_dot_i8_scalar(int32_t *destination, const uint8_t *first, const int8_t *second, uint64_t n, uint64_t count) {
+    for (uint64_t j = 0; j < count; j++) {
+        int32_t sum = 0;
+        for (uint64_t i = 0; i < n; i++) {
+            sum += (int32_t) first[i] * second[j * n + i];
+        }
+        destination[j] = sum;
+    }
+}
+static void kernels_momentum_scalar(nn_scalar_t *weights, const nn_scalar_t *gradient, nn_scalar_t *velocity, uint64_t n, nn_scalar_t rate,
+                                    nn_scalar_t momentum) {
+    for (uint64_t i = 0; i < n; i++) {
+        velocity[i] = momentum * velocity[i] + gradient[i];
+        weights[i] -= rate * velocity[i];
+    }
+}
+static void kernels_adam_scalar(nn_scalar_t *weights, const nn_scalar_t *gradient, nn_scalar_t *first_moment, nn_scalar_t *second_moment, uint64_t n,
+                                nn_scalar_t rate, nn_scalar_t beta1, nn_scalar_t beta2, nn_scalar_t epsilon) {
+    // rate already has the bias correction of both moments folded in
+    for (uint64_t i = 0; i < n; i++) {
+        first_moment[i] = beta1 * first_moment[i] + (1 - beta1) * gradient[i];
+        second_moment[i] = beta2 * second_moment[i] + (1 - beta2) * gradient[i] * gradient[i];
+        weights[i] -= rate * first_moment[i] / (NN_SQRT(second_moment[i]) + epsilon);
+    }
+}
+
+#ifdef KERNELS_X86
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// ---AVX2---
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+// 8 floats per register, a tile row of NN_GEMM_NR = 16 is two registers
+
+#if NN_ACTIVATION == NN_ACTIVATION_SIGMOID
+KERNELS_TARGET_AVX2 static __m256 kernels_exp_avx2(__m256 x) {
+    // Cephes expf: e^x = 2^n * e^r with |r| <= ln(2)/2, ln(2) split in two so that r keeps full precision
+    x = _mm256_min_ps(_mm256_max_ps(x, _mm256_set1_ps(-87.3f)), _mm256_set1_ps(88.3f));
+    __m256 n = _mm256_round_ps(_mm256_mul_ps(x, _mm256_set1_ps(1.44269504088896341f)), _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+    __m256 r = _mm256_fnmadd_ps(n, _mm256_set1_ps(0.693359375f), x);
+    r = _mm256_fnmadd_ps(n, _mm256_set1_ps(-2.12194440e-4f), r);
+    __m256 p = _mm256_set1_ps(1.9875691500e-4f);
+    p = _mm256_fmadd_ps(p, r, _mm256_set1_ps(1.3981999507e-3f));
+    p = _mm256_fmadd_ps(p, r, _mm256_set1_ps(8.3334519073e-3f));
+    p = _mm256_fmadd_ps(p, r, _mm256_set1_ps(4.1665795894e-2f));
+    p = _mm256_fmadd_ps(p, r, _mm256_set1_ps(1.6666665459e-1f));
+    p = _mm256_fmadd_ps(p, r, _mm256_set1_ps(5.0000001201e-1f));
+    p = _mm256_fmadd_ps(p, _mm256_mul_ps(r, r), _mm256_add_ps(r, _mm256_set1_ps(1)));
+    __m256i exponent = _mm256_slli_epi32(_mm256_add_epi32(_mm256_cvtps_epi32(n), _mm256_set1_epi32(127)), 23);
+    return _mm256_mul_ps(p, _mm256_castsi256_ps(exponent));
+}
+KERNELS_TARGET_AVX2 static __m256 kernels_sigmoid_avx2(__m256 x) {
+    __m256 one = _mm256_set1_ps(1);
+    return _mm256_div_ps(one, _mm256_add_ps(one, kernels_exp_avx2(_mm256_sub_ps(_mm256_setzero_ps(), x))));
+}
+#endif
+KERNELS_TARGET_AVX2 static void kernels_dot_avx2(uint64_t depth, const nn_scalar_t *first, const nn_scalar_t *second, nn_scalar_t *destination,
+                                                 uint64_t stride, uint64_t rows, uint64_t columns, bool accumulate) {
+    // The row loops have a constant trip count so that they get unrolled and the accumulators are never indexed at run time, which would force them onto the stack
+    __m256 vector[NN_GEMM_MR][2];
+    for (uint64_t r = 0; r < NN_GEMM_MR; r++) {
+        vector[r][0] = _mm256_setzero_ps();
+        vector[r][1] = _mm256_setzero_ps();
+    }
+    for (uint64_t k = 0; k < depth; k++) {
+        __m256 b0 = _mm256_load_ps(&second[k * NN_GEMM_NR]);
+        __m256 b1 = _mm256_load_ps(&second[k * NN_GEMM_NR + 8]);
+        for (uint64_t r = 0; r < NN_GEMM_MR; r++) {
+            __m256 a = _mm256_broadcast_ss(&first[k * NN_GEMM_MR + r]);
+            vector[r][0] = _mm256_fmadd_ps(a, b0, vector[r][0]);
+            vector[r][1] = _mm256_fmadd_ps(a, b1, vector[r][1]);
+        }
+    }
+    if (rows == NN_GEMM_MR && columns == NN_GEMM_NR) {
+        // Full tiles are by far the common case, so they skip the round trip through sum
+        for (uint64_t r = 0; r < NN_GEMM_MR; r++) {
+            nn_scalar_t *row = &destination[r * stride];
+            _mm256_storeu_ps(&row[0], accumulate ? _mm256_add_ps(_mm256_loadu_ps(&row[0]), vector[r][0]) : vector[r][0]);
+            _mm256_storeu_ps(&row[8], accumulate ? _mm256_add_ps(_mm256_loadu_ps(&row[8]), vector[r][1]) : vector[r][1]);
+        }
+        return;
+    }
+    nn_scalar_t sum[NN_GEMM_MR][NN_GEMM_NR];
+    for (uint64_t r = 0; r < NN_GEMM_MR; r++) {
+        _mm256_storeu_ps(&sum[r][0], vector[r][0]);
+        _mm256_storeu_ps(&sum[r][8], vector[r][1]);
+    }
+    kernels_dot_store(destination, stride, rows, columns, accumulate, sum);
+}
+KERNELS_TARGET_AVX2 static void kernels_add_avx2(nn_scalar_t *destination, const nn_scalar_t *first, uint64_t n) {
+    uint64_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        _mm256_storeu_ps(&destination[i], _mm256_add_ps(_mm256_loadu_ps(&destination[i]), _mm256_loadu_ps(&first[i])));
+    }
+    kernels_add_scalar(&destination[i], &first[i], n - i);
+}
+KERNELS_TARGET_AVX2 static void kernels_axpy_avx2(nn_scalar_t *destination, nn_scalar_t alpha, const nn_scalar_t *first, uint64_t n) {
+    uint64_t i = 0;
+    __m256 a = _mm256_set1_ps(alpha);
+    for (; i + 8 <= n; i += 8) {
+        _mm256_storeu_ps(&destination[i], _mm256_fmadd_ps(a, _mm256_loadu_ps(&first[i]), _mm256_loadu_ps(&destination[i])));
+    }
+    kernels_axpy_scalar(&destination[i], alpha, &first[i], n - i);
+}
+KERNELS_TARGET_AVX2 static void kernels_scale_avx2(nn_scalar_t *destination, nn_scalar_t alpha, uint64_t n) {
+    uint64_t i = 0;
+    __m256 a = _mm256_set1_ps(alpha);
+    for (; i + 8 <= n; i += 8) {
+        _mm256_storeu_ps(&destination[i], _mm256_mul_ps(a, _mm256_loadu_ps(&destination[i])));
+    }
+    kernels_scale_scalar(&destination[i], alpha, n - i);
+}
+KERNELS_TARGET_AVX2 static void kernels_fill_avx2(nn_scalar_t *destination, nn_scalar_t filler, uint64_t n) {
+    uint64_t i = 0;
+    __m256 f = _mm256_set1_ps(filler);
+    for (; i + 8 <= n; i += 8) {
+        _mm256_storeu_ps(&destination[i], f);
+    }
+    kernels_fill_scalar(&destination[i], filler, n - i);
+}
+KERNELS_TARGET_AVX2 static void kernels_copy_avx2(nn_scalar_t *destination, const nn_scalar_t *first, uint64_t n) {
+    uint64_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        _mm256_storeu_ps(&destination[i], _mm256_loadu_ps(&first[i]));
+    }
+    kernels_copy_scalar(&destination[i], &first[i], n - i);
+}
+KERNELS_TARGET_AVX2 static void kernels_activate_avx2(nn_scalar_t *destination, uint64_t n) {
+    uint64_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256 x = _mm256_loadu_ps(&destination[i]);
+#if NN_ACTIVATION == NN_ACTIVATION_SIGMOID
+        _mm256_storeu_ps(&destination[i], kernels_sigmoid_avx2(x));
+#else
+        _mm256_storeu_ps(&destination[i], _mm256_max_ps(x, _mm256_setzero_ps()));
+#endif
+    }
+    kernels_activate_scalar(&destination[i], n - i);
+}
+KERNELS_TARGET_AVX2 static void kernels_d_activate_avx2(nn_scalar_t *destination, const nn_scalar_t *first, uint64_t n) {
+    uint64_t i = 0;
+    __m256 one = _mm256_set1_ps(1);
+    for (; i + 8 <= n; i += 8) {
+        __m256 x = _mm256_loadu_ps(&first[i]);
+#if NN_ACTIVATION == NN_ACTIVATION_SIGMOID
+        __m256 s = kernels_sigmoid_avx2(x);
+        __m256 d = _mm256_mul_ps(s, _mm256_sub_ps(one, s));
+#else
+        __m256 d = _mm256_and_ps(_mm256_cmp_ps(x, _mm256_setzero_ps(), _CMP_GE_OQ), one);
+#endif
+        _mm256_storeu_ps(&destination[i], _mm256_mul_ps(_mm256_loadu_ps(&destination[i]), d));
+    }
+    kernels_d_activate_scalar(&destination[i], &first[i], n - i);
+}
+
+KERNELS_TARGET_AVX2 static void kernels_dot_i8_avx2(int32_t *destination, const uint8_t *first, const int8_t *second, uint64_t n, uint64_t count) {
+    /*
+     * vpmaddubsw multiplies 32 pairs and adds neighbours to 16 bit, vpmaddwd with ones widens those to 32 bit sums. The 16 bit step can't saturate as long as
+     * the activations stay in [0, 127] like quant_t keeps them. Four outputs at a time share every load of first and one horizontal reduction
+     */
+    __m256i ones = _mm256_set1_epi16(1);
+    uint64_t j = 0;
+    for (; j + 4 <= count && n % 32 == 0; j += 4) {
+        __m256i sums[4] = {_mm256_setzero_si256(), _mm256_setzero_si256(), _mm256_setzero_si256(), _mm256_setzero_si256()};
+        for (uint64_t i = 0; i < n; i += 32) {
+            __m256i a = _mm256_loadu_si256((const __m256i*) &first[i]);
+            for (uint64_t r = 0; r < 4; r++) {
+                __m256i products = _mm256_maddubs_epi16(a, _mm256_loadu_si256((const __m256i*) &second[(j + r) * n + i]));
+                sums[r] = _mm256_add_epi32(sums[r], _mm256_madd_epi16(products, ones));
+            }
+        }
+        // Two rounds of hadd leave the four totals split over both lanes, adding the lanes gives them in order
+        __m256i pairs = _mm256_hadd_epi32(_mm256_hadd_epi32(sums[0], sums[1]), _mm256_hadd_epi32(sums[2], sums[3]));
+        __m128i totals = _mm_add_epi32(_mm256_castsi256_si128(pairs), _mm256_extracti128_si256(pairs, 1));
+        _mm_storeu_si128((__m128i*) &destination[j], totals);
+    }
+    kernels_dot_i8_scalar(&destination[j], first, &second[j * n], n, count - j);
+}
+KERNELS_TARGET_AVX2 static void kernels_momentum_avx2(nn_scalar_t *weights, const nn_scalar_t *gradient, nn_scalar_t *velocity, uint64_t n,
+                                                      nn_scalar_t rate, nn_scalar_t momentum) {
+    uint64_t i = 0;
+    __m256 r = _mm256_set1_ps(-rate);
+    __m256 mu = _mm256_set1_ps(momentum);
+    for (; i + 8 <= n; i += 8) {
+        __m256 v = _mm256_fmadd_ps(mu, _mm256_loadu_ps(&velocity[i]), _mm256_loadu_ps(&gradient[i]));
+        _mm256_storeu_ps(&velocity[i], v);
+        _mm256_storeu_ps(&weights[i], _mm256_fmadd_ps(r, v, _mm256_loadu_ps(&weights[i])));
+    }
+    kernels_momentum_scalar(&weights[i], &gradient[i], &velocity[i], n - i, rate, momentum);
+}
+KERNELS_TARGET_AVX2 static void kernels_adam_avx2(nn_scalar_t *weights, const nn_scalar_t *gradient, nn_scalar_t *first_moment, nn_scalar_t *second_moment,
+                                                  uint64_t n, nn_scalar_t rate, nn_scalar_t beta1, nn_scalar_t beta2, nn_scalar_t epsilon) {
+    uint64_t i = 0;
+    __m256 r = _mm256_set1_ps(-rate);
+    __m256 b1 = _mm256_set1_ps(beta1);
+    __m256 c1 = _mm256_set1_ps(1 - beta1);
+    __m256 b2 = _mm256_set1_ps(beta2);
+    __m256 c2 = _mm256_set1_ps(1 - beta2);
+    __m256 e = _mm256_set1_ps(epsilon);
+    for (; i + 8 <= n; i += 8) {
+        __m256 g = _mm256_loadu_ps(&gradient[i]);
+        __m256 m = _mm256_fmadd_ps(b1, _mm256_loadu_ps(&first_moment[i]), _mm256_mul_ps(c1, g));
+        __m256 v = _mm256_fmadd_ps(b2, _mm256_loadu_ps(&second_moment[i]), _mm256_mul_ps(c2, _mm256_mul_ps(g, g)));
+        _mm256_storeu_ps(&first_moment[i], m);
+        _mm256_storeu_ps(&second_moment[i], v);
+        __m256 step = _mm256_div_ps(m, _mm256_add_ps(_mm256_sqrt_ps(v), e));
+        _mm256_storeu_ps(&weights[i], _mm256_fmadd_ps(r, step, _mm256_loadu_ps(&weights[i])));
+    }
+    kernels_adam_scalar(&weights[i], &gradient[i], &first_moment[i], &second_moment[i], n - i, rate, beta1, beta2, epsilon);
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// ---AVX512---
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+// 16 floats per register, a tile row is exactly one register. Tails use masked loads and stores instead of a scalar loop.
+// Byte multiplies need AVX-512BW on top of what this set requires, so the int8 dot product is the AVX2 one
+#define kernels_dot_i8_avx512 kernels_dot_i8_avx2
+
+#define KERNELS_TAIL_MASK(n) ((__mmask16) ((1u << (n)) - 1))
+
+#if NN_ACTIVATION == NN_ACTIVATION_SIGMOID
+KERNELS_TARGET_AVX512 static __m512 kernels_exp_avx512(__m512 x) {
+    // Same polynomial as kernels_exp_avx2, scalef does the multiplication by 2^n without going through the exponent bits
+    x = _mm512_min_ps(_mm512_max_ps(x, _mm512_set1_ps(-87.3f)), _mm512_set1_ps(88.3f));
+    __m512 n = _mm512_roundscale_ps(_mm512_mul_ps(x, _mm512_set1_ps(1.44269504088896341f)), _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+    __m512 r = _mm512_fnmadd_ps(n, _mm512_set1_ps(0.693359375f), x);
+    r = _mm512_fnmadd_ps(n, _mm512_set1_ps(-2.12194440e-4f), r);
+    __m512 p = _mm512_set1_ps(1.9875691500e-4f);
+    p = _mm512_fmadd_ps(p, r, _mm512_set1_ps(1.3981999507e-3f));
+    p = _mm512_fmadd_ps(p, r, _mm512_set1_ps(8.3334519073e-3f));
+    p = _mm512_fmadd_ps(p, r, _mm512_set1_ps(4.1665795894e-2f));
+    p = _mm512_fmadd_ps(p, r, _mm512_set1_ps(1.6666665459e-1f));
+    p = _mm512_fmadd_ps(p, r, _mm512_set1_ps(5.0000001201e-1f));
+    p = _mm512_fmadd_ps(p, _mm512_mul_ps(r, r), _mm512_add_ps(r, _mm512_set1_ps(1)));
+    return _mm512_scalef_ps(p, n);
+}
+KERNELS_TARGET_AVX512 static __m512 kernels_sigmoid_avx512(__m512 x) {
+    __m512 one = _mm512_set1_ps(1);
+    return _mm512_div_ps(one, _mm512_add_ps(one, kernels_exp_avx512(_mm512_sub_ps(_mm512_setzero_ps(), x))));
+}
+#endif
+KERNELS_TARGET_AVX512 static void kernels_dot_avx512(uint64_t depth, const nn_scalar_t *first, const nn_scalar_t *second, nn_scalar_t *destination,
+                                                     uint64_t stride, uint64_t rows, uint64_t columns, bool accumulate) {
+    __m512 vector[NN_GEMM_MR];
+    for (uint64_t r = 0; r < NN_GEMM_MR; r++) {
+        vector[r] = _mm512_setzero_ps();
+    }
+    for (uint64_t k = 0; k < depth; k++) {
+        __m512 b = _mm512_load_ps(&second[k * NN_GEMM_NR]);
+        for (uint64_t r = 0; r < NN_GEMM_MR; r++) {
+            vector[r] = _mm512_fmadd_ps(_mm512_set1_ps(first[k * NN_GEMM_MR + r]), b, vector[r]);
+        }
+    }
+    if (rows == NN_GEMM_MR && columns == NN_GEMM_NR) {
+        // Full tiles are by far the common case, so they skip the round trip through sum
+        for (uint64_t r = 0; r < NN_GEMM_MR; r++) {
+            nn_scalar_t *row = &destination[r * stride];
+            _mm512_storeu_ps(row, accumulate ? _mm512_add_ps(_mm512_loadu_ps(row), vector[r]) : vector[r]);
+        }
+        return;
+    }
+    nn_scalar_t sum[NN_GEMM_MR][NN_GEMM_NR];
+    for (uint64_t r = 0; r < NN_GEMM_MR; r++) {
+        _mm512_storeu_ps(sum[r], vector[r]);
+    }
+    kernels_dot_store(destination, stride, rows, columns, accumulate, sum);
+}
+KERNELS_TARGET_AVX512 static void kernels_add_avx512(nn_scalar_t *destination, const nn_scalar_t *first, uint64_t n) {
+    for (uint64_t i = 0; i < n; i += 16) {
+        __mmask16 m = n - i >= 16 ? (__mmask16) 0xFFFF : KERNELS_TAIL_MASK(n - i);
+        __m512 sum = _mm512_add_ps(_mm512_maskz_loadu_ps(m, &destination[i]), _mm512_maskz_loadu_ps(m, &first[i]));
+        _mm512_mask_storeu_ps(&destination[i], m, sum);
+    }
+}
+KERNELS_TARGET_AVX512 static void kernels_axpy_avx512(nn_scalar_t *destination, nn_scalar_t alpha, const nn_scalar_t *first, uint64_t n) {
+    __m512 a = _mm512_set1_ps(alpha);
+    for (uint64_t i = 0; i < n; i += 16) {
+        __mmask16 m = n - i >= 16 ? (__mmask16) 0xFFFF : KERNELS_TAIL_MASK(n - i);
+        __m512 sum = _mm512_fmadd_ps(a, _mm512_maskz_loadu_ps(m, &first[i]), _mm512_maskz_loadu_ps(m, &destination[i]));
+        _mm512_mask_storeu_ps(&destination[i], m, sum);
+    }
+}
+KERNELS_TARGET_AVX512 static void kernels_scale_avx512(nn_scalar_t *destination, nn_scalar_t alpha, uint64_t n) {
+    __m512 a = _mm512_set1_ps(alpha);
+    for (uint64_t i = 0; i < n; i += 16) {
+        __mmask16 m = n - i >= 16 ? (__mmask16) 0xFFFF : KERNELS_TAIL_MASK(n - i);
+        _mm512_mask_storeu_ps(&destination[i], m, _mm512_mul_ps(a, _mm512_maskz_loadu_ps(m, &destination[i])));
+    }
+}
+KERNELS_TARGET_AVX512 static void kernels_fill_avx512(nn_scalar_t *destination, nn_scalar_t filler, uint64_t n) {
+    __m512 f = _mm512_set1_ps(filler);
+    for (uint64_t i = 0; i < n; i += 16) {
+        __mmask16 m = n - i >= 16 ? (__mmask16) 0xFFFF : KERNELS_TAIL_MASK(n - i);
+        _mm512_mask_storeu_ps(&destination[i], m, f);
+    }
+}
+KERNELS_TARGET_AVX512 static void kernels_copy_avx512(nn_scalar_t *destination, const nn_scalar_t *first, uint64_t n) {
+    for (uint64_t i = 0; i < n; i += 16) {
+        __mmask16 m = n - i >= 16 ? (__mmask16) 0xFFFF : KERNELS_TAIL_MASK(n - i);
+        _mm512_mask_storeu_ps(&destination[i], m, _mm512_maskz_loadu_ps(m, &first[i]));
+    }
+}
+KERNELS_TARGET_AVX512 static void kernels_activate_avx512(nn_scalar_t *destination, uint64_t n) {
+    for (uint64_t i = 0; i < n; i += 16) {
+        __mmask16 m = n - i >= 16 ? (__mmask16) 0xFFFF : KERNELS_TAIL_MASK(n - i);
+        __m512 x = _mm512_maskz_loadu_ps(m, &destination[i]);
+#if NN_ACTIVATION == NN_ACTIVATION_SIGMOID
+        _mm512_mask_storeu_ps(&destination[i], m, kernels_sigmoid_avx512(x));
+#else
+        _mm512_mask_storeu_ps(&destination[i], m, _mm512_max_ps(x, _mm512_setzero_ps()));
+#endif
+    }
+}
+KERNELS_TARGET_AVX512 static void kernels_d_activate_avx512(nn_scalar_t *destination, const nn_scalar_t *first, uint64_t n) {
+    __m512 one = _mm512_set1_ps(1);
+    for (uint64_t i = 0; i < n; i += 16) {
+        __mmask16 m = n - i >= 16 ? (__mmask16) 0xFFFF : KERNELS_TAIL_MASK(n - i);
+        __m512 x = _mm512_maskz_loadu_ps(m, &first[i]);
+#if NN_ACTIVATION == NN_ACTIVATION_SIGMOID
+        __m512 s = kernels_sigmoid_avx512(x);
+        __m512 d = _mm512_mul_ps(s, _mm512_sub_ps(one, s));
+#else
+        __m512 d = _mm512_maskz_mov_ps(_mm512_cmp_ps_mask(x, _mm512_setzero_ps(), _CMP_GE_OQ), one);
+#endif
+        _mm512_mask_storeu_ps(&destination[i], m, _mm512_mul_ps(_mm512_maskz_loadu_ps(m, &destination[i]), d));
+    }
+}
+
+KERNELS_TARGET_AVX512 static void kernels_momentum_avx512(nn_scalar_t *weights, const nn_scalar_t *gradient, nn_scalar_t *velocity, uint64_t n,
+                                                          nn_scalar_t rate, nn_scalar_t momentum) {
+    __m512 r = _mm512_set1_ps(-rate);
+    __m512 mu = _mm512_set1_ps(momentum);
+    for (uint64_t i = 0; i < n; i += 16) {
+        __mmask16 k = n - i >= 16 ? (__mmask16) 0xFFFF : KERNELS_TAIL_MASK(n - i);
+        __m512 v = _mm512_fmadd_ps(mu, _mm512_maskz_loadu_ps(k, &velocity[i]), _mm512_maskz_loadu_ps(k, &gradient[i]));
+        _mm512_mask_storeu_ps(&velocity[i], k, v);
+        _mm512_mask_storeu_ps(&weights[i], k, _mm512_fmadd_ps(r, v, _mm512_maskz_loadu_ps(k, &weights[i])));
+    }
+}
+KERNELS_TARGET_AVX512 static void kernels_adam_avx512(nn_scalar_t *weights, const nn_scalar_t *gradient, nn_scalar_t *first_moment,
+                                                      nn_scalar_t *second_moment, uint64_t n, nn_scalar_t rate, nn_scalar_t beta1, nn_scalar_t beta2,
+                                                      nn_scalar_t epsilon) {
+    __m512 r = _mm512_set1_ps(-rate);
+    __m512 b1 = _mm512_set1_ps(beta1);
+    __m512 c1 = _mm512_set1_ps(1 - beta1);
+    __m512 b2 = _mm512_set1_ps(beta2);
+    __m512 c2 = _mm512_set1_ps(1 - beta2);
+    __m512 e = _mm512_set1_ps(epsilon);
+    for (uint64_t i = 0; i < n; i += 16) {
+        __mmask16 k = n - i >= 16 ? (__mmask16) 0xFFFF : KERNELS_TAIL_MASK(n - i);
+        __m512 g = _mm512_maskz_loadu_ps(k, &gradient[i]);
+        __m512 m = _mm512_fmadd_ps(b1, _mm512_maskz_loadu_ps(k, &first_moment[i]), _mm512_mul_ps(c1, g));
+        __m512 v = _mm512_fmadd_ps(b2, _mm512_maskz_loadu_ps(k, &second_moment[i]), _mm512_mul_ps(c2, _mm512_mul_ps(g, g)));
+        _mm512_mask_storeu_ps(&first_moment[i], k, m);
+        _mm512_mask_storeu_ps(&second_moment[i], k, v);
+        __m512 step = _mm512_div_ps(m, _mm512_add_ps(_mm512_sqrt_ps(v), e));
+        _mm512_mask_storeu_ps(&weights[i], k, _mm512_fmadd_ps(r, step, _mm512_maskz_loadu_ps(k, &weights[i])));
+    }
+}
+
+#endif
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// ---DISPATCH---
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#define KERNELS_SET(suffix) {                                                                                                         \
+    .isa = kernels_##suffix, .name = #suffix, .dot = kernels_dot_##suffix, .add = kernels_add_##suffix, .axpy = kernels_axpy_##suffix,    \
+    .scale = kernels_scale_##suffix, .fill = kernels_fill_##suffix, .copy = kernels_copy_##suffix,                                    \
+    .activate = kernels_activate_##suffix, .d_activate = kernels_d_activate_##suffix, .momentum = kernels_momentum_##suffix,           \
+    .adam = kernels_adam_##suffix, .dot_i8 = kernels_dot_i8_##suffix,                                                                 \
+}
+
+kernels_t kernels = KERNELS_SET(scalar);
+
+bool kernels_supported(enum kernels_isa isa) {
+    switch (isa) {
+    case kernels_scalar:
+        return true;
+#ifdef KERNELS_X86
+    // __builtin_cpu_supports reads cpuid and also checks that the OS saves the wider registers
+    case kernels_avx2:
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+    case kernels_avx512:
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+#endif
+    default:
+        return false;
+    }
+}
+void kernels_select(enum kernels_isa isa) {
+    assert(kernels_supported(isa));
+    switch (isa) {
+#ifdef KERNELS_X86
+    case kernels_avx2:
+        kernels = (kernels_t) KERNELS_SET(avx2);
+        break;
+    case kernels_avx512:
+        kernels = (kernels_t) KERNELS_SET(avx512);
+        break;
+#endif
+    default:
+        kernels = (kernels_t) KERNELS_SET(scalar);
+        break;
+    }
+}
+static void kernels_init_once(void) {
+    const char *names[] = {"scalar", "avx2", "avx512"};
+    const char *forced = getenv(KERNELS_ENV);
+    if (forced != NULL && forced[0] != '\0') {
+        for (enum kernels_isa isa = kernels_scalar; isa <= kernels_avx512; isa++) {
+            if (strcmp(forced, names[isa]) != 0) {
+                continue;
+            }
+            if (!kernels_supported(isa)) {
+                fprintf(stderr, "ERROR: %s=%s but this cpu or build does not support it\n", KERNELS_ENV, forced);
+                exit(1);
+            }
+            kernels_select(isa);
+            return;
+        }
+        fprintf(stderr, "ERROR: Unknown %s=%s, valid are scalar, avx2 and avx512\n", KERNELS_ENV, forced);
+        exit(1);
+    }
+    for (enum kernels_isa isa = kernels_avx512; isa > kernels_scalar; isa--) {
+        if (kernels_supported(isa)) {
+            kernels_select(isa);
+            return;
+        }
+    }
+}
+void kernels_init(void) {
+    // Called from every matrix and net allocation, pthread_once makes sure the table is written once and seen by every thread that got past this
+    static pthread_once_t once = PTHREAD_ONCE_INIT;
+    pthread_once(&once, kernels_init_once);
+}
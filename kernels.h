@@ -0,0 +1,45 @@
+#ifndef KERNELS_H
+#define KERNELS_H
+
+#include "nn.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+// Name of the environment variable that forces one kernel set, for benchmarking. Valid values are the names below
+#define KERNELS_ENV "BLADE_KERNELS"
+
+enum kernels_isa {
+    kernels_scalar = 0, kernels_avx2 = 1, kernels_avx512 = 2
+};
+
+// Elementwise kernels work on one contiguous row of n values, the matrix functions call them once per row so that strided views keep working.
+// dot_i8 is the int8 product of quantized inference, the dot products of count consecutive rows of n signed weights with the same n unsigned activations
+// in 32 bits, see quant_forward.
+// momentum and adam are the fused optimizer updates, they read the gradient and the state and write state and weights in one pass, see optim_step.
+// dot computes one NN_GEMM_MR x NN_GEMM_NR tile of matrix_dot from packed panels and writes the rows x columns part of it that is inside the destination
+typedef struct {
+    enum kernels_isa isa;
+    const char *name;
+    void (*dot)(uint64_t depth, const nn_scalar_t *first, const nn_scalar_t *second, nn_scalar_t *destination, uint64_t stride, uint64_t rows,
+                uint64_t columns, bool accumulate);
+    void (*add)(nn_scalar_t *destination, const nn_scalar_t *first, uint64_t n);
+    void (*axpy)(nn_scalar_t *destination, nn_scalar_t alpha, const nn_scalar_t *first, uint64_t n);
+    void (*scale)(nn_scalar_t *destination, nn_scalar_t alpha, uint64_t n);
+    void (*fill)(nn_scalar_t *destination, nn_scalar_t filler, uint64_t n);
+    void (*copy)(nn_scalar_t *destination, const nn_scalar_t *first, uint64_t n);
+    void (*activate)(nn_scalar_t *destination, uint64_t n);
+    void (*d_activate)(nn_scalar_t *destination, const nn_scalar_t *first, uint64_t n);
+    void (*dot_i8)(int32_t *destination, const uint8_t *first, const int8_t *second, uint64_t n, uint64_t count);
+    void (*momentum)(nn_scalar_t *weights, const nn_scalar_t *gradient, nn_scalar_t *velocity, uint64_t n, nn_scalar_t rate, nn_scalar_t momentum);
+    void (*adam)(nn_scalar_t *weights, const nn_scalar_t *gradient, nn_scalar_t *first_moment, nn_scalar_t *second_moment, uint64_t n, nn_scalar_t rate,
+                 nn_scalar_t beta1, nn_scalar_t beta2, nn_scalar_t epsilon);
+} kernels_t;
+
+// Starts out as the scalar set, kernels_init switches it to the fastest set the cpu supports
+extern kernels_t kernels;
+
+extern void kernels_init(void);
+extern bool kernels_supported(enum kernels_isa isa);
+extern void kernels_select(enum kernels_isa isa);
+
+#endif
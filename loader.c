@@ -0,0 +1,168 @@
+#include "loader.h"
+#include "nn.h"
+#include <assert.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+
+static void *loader_thread(void *argument) {
+    /*
+     * Decodes into the next free buffer without holding the lock, so the trainer only ever waits if decoding is slower than a training step
+     */
+    loader_t *loader = argument;
+    pthread_mutex_lock(&loader->mutex);
+    while(!loader->quit) {
+        if(loader->ready + loader->holding >= loader->buffer_count) {
+            pthread_cond_wait(&loader->emptied, &loader->mutex);
+            continue;
+        }
+        int64_t index = loader->produce;
+        pthread_mutex_unlock(&loader->mutex);
+
+        batch b = loader->buffers[index];
+        bool more = loader->fill(loader->context, &b);
+
+        pthread_mutex_lock(&loader->mutex);
+        if(!more || b.input.rows == 0) {
+            loader->done = true;
+            pthread_cond_signal(&loader->filled);
+            break;
+        }
+        loader->rows[index] = b.input.rows;
+        loader->produce = (index + 1) % loader->buffer_count;
+        loader->ready++;
+        pthread_cond_signal(&loader->filled);
+    }
+    pthread_mutex_unlock(&loader->mutex);
+    return(NULL);
+}
+loader_t *loader_alloc(uint64_t rows, uint64_t input_columns, uint64_t output_columns, int64_t buffer_count, loader_fill_t fill, void *context) {
+    /*
+     * Starts a thread that keeps up to buffer_count - 1 batches of rows samples decoded ahead of the one the trainer is using, 2 is plain double buffering.
+     * The buffers are locked into memory if the system allows it, so that a batch never has to be paged back in right when it is needed
+     */
+    assert(buffer_count >= 2 && buffer_count <= LOADER_BUFFERS_MAX);
+    assert(rows > 0);
+    loader_t *loader = calloc(1, sizeof(*loader));
+    assert(loader != NULL);
+    loader->fill = fill;
+    loader->context = context;
+    loader->buffer_count = buffer_count;
+    loader->buffer_rows = rows;
+    loader->input_columns = input_columns;
+    loader->output_columns = output_columns;
+    for(int64_t i = 0; i < buffer_count; i++) {
+        loader->buffers[i] = batch_malloc(rows, input_columns, output_columns);
+        // Failing to lock only costs page faults, so this is not an error
+        mlock(loader->buffers[i].input.values, sizeof(nn_scalar_t) * rows * input_columns);
+        mlock(loader->buffers[i].output.values, sizeof(nn_scalar_t) * rows * output_columns);
+    }
+    pthread_mutex_init(&loader->mutex, NULL);
+    pthread_cond_init(&loader->filled, NULL);
+    pthread_cond_init(&loader->emptied, NULL);
+    if(pthread_create(&loader->thread, NULL, loader_thread, loader) != 0) {
+        fprintf(stderr, "ERROR: Could not start the loader thread\n");
+        exit(1);
+    }
+    return(loader);
+}
+void loader_free(loader_t *loader) {
+    pthread_mutex_lock(&loader->mutex);
+    loader->quit = true;
+    pthread_cond_signal(&loader->emptied);
+    pthread_mutex_unlock(&loader->mutex);
+    pthread_join(loader->thread, NULL);
+    for(int64_t i = 0; i < loader->buffer_count; i++) {
+        /*
+         * Small buffers come from the heap instead of a mapping of their own, so free doesn't drop the lock. Without this the pages stay locked until exit,
+         * and every loader eats more of RLIMIT_MEMLOCK. Unlocking memory that never got locked just fails, which is fine
+         */
+        munlock(loader->buffers[i].input.values, sizeof(nn_scalar_t) * loader->buffer_rows * loader->input_columns);
+        munlock(loader->buffers[i].output.values, sizeof(nn_scalar_t) * loader->buffer_rows * loader->output_columns);
+        batch_free(loader->buffers[i]);
+    }
+    pthread_mutex_destroy(&loader->mutex);
+    pthread_cond_destroy(&loader->filled);
+    pthread_cond_destroy(&loader->emptied);
+    free(loader);
+}
+bool loader_next(loader_t *loader, batch *b) {
+    /*
+     * Hands the batch from the previous call back to the loader and waits for the next one. Returns false once the stream has ended and every batch was handed out
+     */
+    pthread_mutex_lock(&loader->mutex);
+    if(loader->holding) {
+        loader->holding = false;
+        loader->consume = (loader->consume + 1) % loader->buffer_count;
+        pthread_cond_signal(&loader->emptied);
+    }
+    while(loader->ready == 0 && !loader->done) {
+        pthread_cond_wait(&loader->filled, &loader->mutex);
+    }
+    if(loader->ready == 0) {
+        pthread_mutex_unlock(&loader->mutex);
+        return(false);
+    }
+    loader->ready--;
+    loader->holding = true;
+    b->input = matrix_rows(loader->buffers[loader->consume].input, 0, loader->rows[loader->consume]);
+    b->output = matrix_rows(loader->buffers[loader->consume].output, 0, loader->rows[loader->consume]);
+    pthread_mutex_unlock(&loader->mutex);
+    return(true);
+}
+loader_file_t *loader_file_open(const char *path, uint64_t input_columns, uint64_t output_columns) {
+    loader_file_t *file = calloc(1, sizeof(*file));
+    assert(file != NULL);
+    file->file = fopen(path, "rb");
+    if(file->file == NULL) {
+        fprintf(stderr, "ERROR: Could not open %s\n", path);
+        free(file);
+        return(NULL);
+    }
+    file->input_columns = input_columns;
+    file->output_columns = output_columns;
+    file->record = malloc(sizeof(*file->record) * (input_columns + output_columns));
+    assert(file->record != NULL);
+    return(file);
+}
+void loader_file_close(loader_file_t *file) {
+    fclose(file->file);
+    free(file->record);
+    free(file);
+}
+bool loader_file_fill(void *context, batch *b) {
+    /*
+     * A loader_fill_t that streams a file written by loader_file_append, one pass over it. The file is read sequentially so the kernel readahead does the rest
+     */
+    loader_file_t *file = context;
+    uint64_t columns = file->input_columns + file->output_columns;
+    uint64_t rows = 0;
+    for(; rows < b->input.rows; rows++) {
+        if(fread(file->record, sizeof(*file->record), columns, file->file) != columns) {
+            break;
+        }
+        for(uint64_t j = 0; j < file->input_columns; j++) {
+            MATRIX_AT(b->input, rows, j) = file->record[j];
+        }
+        for(uint64_t j = 0; j < file->output_columns; j++) {
+            MATRIX_AT(b->output, rows, j) = file->record[file->input_columns + j];
+        }
+    }
+    b->input.rows = rows;
+    b->output.rows = rows;
+    return(rows > 0);
+}
+bool loader_file_append(FILE *file, matrix_t input, matrix_t output) {
+    // Writes the samples in the format loader_file_fill reads, so data sets can be generated in pieces, for example by self-play
+    assert(input.rows == output.rows);
+    for(uint64_t i = 0; i < input.rows; i++) {
+        if(fwrite(&MATRIX_AT(input, i, 0), sizeof(nn_scalar_t), input.columns, file) != input.columns ||
+           fwrite(&MATRIX_AT(output, i, 0), sizeof(nn_scalar_t), output.columns, file) != output.columns) {
+            return(false);
+        }
+    }
+    return(true);
+}
@@ -0,0 +1,55 @@
+#ifndef LOADER_H
+#define LOADER_H
+
+#include "nn.h"
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#define LOADER_BUFFERS_MAX 16
+
+// Fills b with up to b->input.rows samples and shrinks the rows of b to the amount it produced. Returning false ends the stream, b is then ignored.
+// Runs on the loader thread, so context must not be touched by anyone else while the loader is running
+typedef bool (*loader_fill_t)(void *context, batch *b);
+
+typedef struct {
+    loader_fill_t fill;
+    void *context;
+    int64_t buffer_count;
+    batch buffers[LOADER_BUFFERS_MAX]; // Allocated once, every batch is decoded straight into one of these
+    // Size every buffer was allocated and locked with, so that loader_free unlocks exactly that
+    uint64_t buffer_rows;
+    uint64_t input_columns;
+    uint64_t output_columns;
+    uint64_t rows[LOADER_BUFFERS_MAX]; // Filled rows of each buffer
+    // Buffers form a ring, the producer fills at produce and the consumer reads at consume
+    int64_t produce;
+    int64_t consume;
+    int64_t ready; // Filled and not handed out yet
+    bool holding; // The consumer still uses the buffer at consume
+    bool done;
+    bool quit;
+    pthread_mutex_t mutex;
+    pthread_cond_t filled;
+    pthread_cond_t emptied;
+    pthread_t thread;
+} loader_t;
+
+// Samples stored back to back as raw nn_scalar_t, input_columns inputs followed by output_columns outputs per sample
+typedef struct {
+    FILE *file;
+    uint64_t input_columns;
+    uint64_t output_columns;
+    nn_scalar_t *record;
+} loader_file_t;
+
+extern loader_t *loader_alloc(uint64_t rows, uint64_t input_columns, uint64_t output_columns, int64_t buffer_count, loader_fill_t fill, void *context);
+extern void loader_free(loader_t *loader);
+extern bool loader_next(loader_t *loader, batch *b);
+extern loader_file_t *loader_file_open(const char *path, uint64_t input_columns, uint64_t output_columns);
+extern void loader_file_close(loader_file_t *file);
+extern bool loader_file_fill(void *context, batch *b);
+extern bool loader_file_append(FILE *file, matrix_t input, matrix_t output);
+
+#endif
@@ -5,14 +5,25 @@
 #include <stdint.h>
 #include <time.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "chess.h"
 #include "nn.h"
+#include "quant.h"
+#include "uci.h"
 
 struct timespec tstart={0, 0}, tend={0, 0};
 #define r (rand() % chess_movelist_count(board.movelist))
 
-int main(void) {
+int main(int argc, char **argv) {
+    if(argc > 1 && strcmp(argv[1], "uci") == 0) {
+        uci_loop();
+        return(0);
+    }
+    if(argc > 3 && strcmp(argv[1], "quant") == 0) {
+        // blade quant <model> <data>, reports how much accuracy int8 inference loses on a data set
+        return(quant_calibrate_file(argv[2], argv[3]) ? 0 : 1);
+    }
     int64_t seed = time(NULL);
     printf("Seed: %lu\n", seed);
     srand(seed);
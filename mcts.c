@@ -0,0 +1,291 @@
+#include "mcts.h"
+#include "chess.h"
+#include "nn.h"
+#include <assert.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static void mcts_node_init(mcts_node_t *node, move_t move, mcts_node_t *parent, long double prior) {
+    node->move           = move;
+    node->parent         = parent;
+    node->children       = NULL;
+    node->child_count    = 0;
+    node->prior          = prior;
+    node->terminal_value = 0;
+    atomic_init(&node->state, mcts_leaf);
+    atomic_init(&node->visits, 0);
+    atomic_init(&node->virtual_loss, 0);
+    atomic_init(&node->value, 0);
+}
+mcts_t *mcts_alloc(int64_t node_capacity, int64_t thread_count, mcts_evaluate_fn evaluate, void **contexts) {
+    /*
+     * contexts has one entry per thread which is handed to evaluate through mcts_worker_t.context, it may be NULL for evaluators that don't need one
+     */
+    assert(thread_count > 0 && thread_count <= MCTS_THREADS_MAX);
+    assert(node_capacity > 0);
+    mcts_t *mcts = calloc(1, sizeof(*mcts));
+    assert(mcts != NULL);
+    mcts->nodes = malloc(sizeof(*mcts->nodes) * node_capacity);
+    assert(mcts->nodes != NULL);
+    mcts->node_capacity = node_capacity;
+    mcts->thread_count = thread_count;
+    mcts->evaluate = evaluate;
+    mcts->root_board = chess_board_alloc();
+    for(int64_t i = 0; i < thread_count; i++) {
+        mcts->workers[i].mcts = mcts;
+        mcts->workers[i].board = chess_board_alloc();
+        mcts->workers[i].rng = 0x9E3779B97F4A7C15ULL * (i + 1);
+        mcts->workers[i].context = contexts == NULL ? NULL : contexts[i];
+    }
+    mcts_reset(mcts);
+    return(mcts);
+}
+void mcts_free(mcts_t *mcts) {
+    for(int64_t i = 0; i < mcts->thread_count; i++) {
+        free(mcts->workers[i].board.square);
+        free(mcts->workers[i].board.movelist);
+    }
+    free(mcts->root_board.square);
+    free(mcts->root_board.movelist);
+    free(mcts->nodes);
+    free(mcts);
+}
+void mcts_reset(mcts_t *mcts) {
+    atomic_store(&mcts->node_count, 1);
+    mcts->root = &mcts->nodes[0];
+    mcts_node_init(mcts->root, chess_move_alloc(), NULL, 1);
+}
+static bool mcts_board_equal(board_t *first, board_t *second) {
+    return(first->stm == second->stm &&
+           first->castle_perm == second->castle_perm &&
+           first->en_passant_sq == second->en_passant_sq &&
+           memcmp(first->square, second->square, sizeof(*first->square) * BOARDTOP) == 0);
+}
+void mcts_set_root(mcts_t *mcts, board_t *board) {
+    /*
+     * Reuses the subtree if board is the current root or is reached from it by one or two moves, which covers both our last move and the opponents reply.
+     * Nodes are never freed individually, so once the pool is more than half used up the tree is thrown away instead of reused
+     */
+    board_t *scratch = &mcts->workers[0].board;
+    mcts_node_t *found = NULL;
+    if(mcts_board_equal(&mcts->root_board, board)) {
+        found = mcts->root;
+    }
+    for(int64_t i = 0; found == NULL && atomic_load(&mcts->root->state) == mcts_expanded && i < mcts->root->child_count; i++) {
+        mcts_node_t *child = &mcts->root->children[i];
+        chess_board_copy(scratch, &mcts->root_board);
+        chess_make_move(scratch, &child->move);
+        scratch->stm = -scratch->stm;
+        if(mcts_board_equal(scratch, board)) {
+            found = child;
+            break;
+        }
+        for(int64_t j = 0; atomic_load(&child->state) == mcts_expanded && j < child->child_count; j++) {
+            chess_make_move(scratch, &child->children[j].move);
+            scratch->stm = -scratch->stm;
+            if(mcts_board_equal(scratch, board)) {
+                found = &child->children[j];
+                break;
+            }
+            scratch->stm = -scratch->stm;
+            chess_undo_move(scratch, &child->children[j].move);
+        }
+    }
+    chess_board_copy(&mcts->root_board, board);
+    if(found == NULL || atomic_load(&mcts->node_count) > mcts->node_capacity / 2) {
+        mcts_reset(mcts);
+        return;
+    }
+    mcts->root = found;
+    mcts->root->parent = NULL;
+}
+static void mcts_expand(mcts_t *mcts, mcts_node_t *node, board_t *board, move_t *temp) {
+    /*
+     * Only the thread that wins the race from mcts_leaf to mcts_expanding generates the children, everybody else just evaluates the node as a leaf in the meantime
+     */
+    int expected = mcts_leaf;
+    if(!atomic_compare_exchange_strong(&node->state, &expected, mcts_expanding)) {
+        return;
+    }
+    chess_board_legal_moves(board, temp, board->stm);
+    enum color result = chess_board_result(board);
+    if(result != c_e) {
+        node->terminal_value = result;
+        atomic_store(&node->state, mcts_terminal);
+        return;
+    }
+    int64_t count = chess_movelist_count(board->movelist);
+    // Only reserve the children if they fit, so that node_count never goes past the capacity and mcts_set_root can trust it
+    int64_t first = atomic_load(&mcts->node_count);
+    do {
+        if(first + count > mcts->node_capacity) {
+            // The pool is full, so this is evaluated as a leaf from now on without generating its moves again
+            atomic_store(&node->state, mcts_full);
+            return;
+        }
+    } while(!atomic_compare_exchange_weak(&mcts->node_count, &first, first + count));
+    for(int64_t i = 0; i < count; i++) {
+        mcts_node_init(&mcts->nodes[first + i], board->movelist[i], node, 1.0L / count);
+    }
+    node->children = &mcts->nodes[first];
+    node->child_count = count;
+    atomic_store(&node->state, mcts_expanded);
+}
+static mcts_node_t *mcts_select(mcts_node_t *node) {
+    /*
+     * PUCT, every pending virtual loss counts as a lost visit so that concurrent workers spread out over different children
+     */
+    long double sqrt_visits = sqrtl((long double) atomic_load(&node->visits) + 1);
+    long double best_score = -INFINITY;
+    mcts_node_t *best = NULL;
+    for(int64_t i = 0; i < node->child_count; i++) {
+        mcts_node_t *child = &node->children[i];
+        int64_t virtual_loss = atomic_load(&child->virtual_loss);
+        int64_t visits = atomic_load(&child->visits) + virtual_loss;
+        long double q = 0;
+        if(visits > 0) {
+            q = ((long double) atomic_load(&child->value) / MCTS_VALUE_SCALE - virtual_loss) / visits;
+        }
+        long double score = q + MCTS_C_PUCT * child->prior * sqrt_visits / (1 + visits);
+        if(score > best_score) {
+            best_score = score;
+            best = child;
+        }
+    }
+    return(best);
+}
+static void mcts_iterate(mcts_worker_t *worker) {
+    mcts_t *mcts = worker->mcts;
+    board_t *board = &worker->board;
+    mcts_node_t *node = mcts->root;
+    chess_board_copy(board, &mcts->root_board);
+    while(atomic_load(&node->state) == mcts_expanded) {
+        node = mcts_select(node);
+        atomic_fetch_add(&node->virtual_loss, 1);
+        chess_make_move(board, &node->move);
+        board->stm = -board->stm;
+    }
+    if(atomic_load(&node->state) == mcts_leaf) {
+        mcts_expand(mcts, node, board, worker->temp);
+    }
+    // The side that played the move into the leaf, which is the perspective that node->value is kept in
+    enum color mover = -board->stm;
+    long double value = atomic_load(&node->state) == mcts_terminal ? node->terminal_value : mcts->evaluate(worker, board);
+    bool aborted = isnan(value);
+    while(node != NULL) {
+        if(!aborted) {
+            atomic_fetch_add(&node->visits, 1);
+            atomic_fetch_add(&node->value, (int64_t) llroundl(value * mover * MCTS_VALUE_SCALE));
+        }
+        if(node != mcts->root) {
+            atomic_fetch_sub(&node->virtual_loss, 1);
+        }
+        mover = -mover;
+        node = node->parent;
+    }
+    worker->playouts += !aborted;
+}
+static void *mcts_worker(void *argument) {
+    mcts_worker_t *worker = argument;
+    mcts_t *mcts = worker->mcts;
+    while(!atomic_load(&mcts->done)) {
+        if(mcts->stop != NULL && mcts->stop(mcts->stop_context)) {
+            break;
+        }
+        if(mcts->playout_limit > 0 && atomic_fetch_add(&mcts->playouts, 1) >= mcts->playout_limit) {
+            break;
+        }
+        mcts_iterate(worker);
+    }
+    // Once one worker stops all of them should, the stop condition might not be true for everybody (e.g. the playout limit)
+    atomic_store(&mcts->done, true);
+    return(NULL);
+}
+move_t mcts_search(mcts_t *mcts, int64_t playout_limit, mcts_stop_fn stop, void *stop_context) {
+    /*
+     * Runs thread_count workers over the shared tree until stop returns true or playout_limit (if > 0) playouts are done.
+     * Returns the most visited root move, or an empty move if the root position has none
+     */
+    pthread_t threads[MCTS_THREADS_MAX];
+    mcts->stop = stop;
+    mcts->stop_context = stop_context;
+    mcts->playout_limit = playout_limit;
+    atomic_store(&mcts->playouts, 0);
+    atomic_store(&mcts->done, false);
+    // Expanding the root up front guarantees a move even if the search gets stopped right away
+    chess_board_copy(&mcts->workers[0].board, &mcts->root_board);
+    mcts_expand(mcts, mcts->root, &mcts->workers[0].board, mcts->workers[0].temp);
+    for(int64_t i = 0; i < mcts->thread_count; i++) {
+        mcts->workers[i].playouts = 0;
+    }
+    for(int64_t i = 1; i < mcts->thread_count; i++) {
+        if(pthread_create(&threads[i], NULL, mcts_worker, &mcts->workers[i]) != 0) {
+            fprintf(stderr, "ERROR: Could not start mcts worker %ld\n", i);
+            exit(1);
+        }
+    }
+    mcts_worker(&mcts->workers[0]);
+    for(int64_t i = 1; i < mcts->thread_count; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    if(atomic_load(&mcts->root->state) != mcts_expanded) {
+        return(chess_move_alloc());
+    }
+    mcts_node_t *best = &mcts->root->children[0];
+    for(int64_t i = 1; i < mcts->root->child_count; i++) {
+        if(atomic_load(&mcts->root->children[i].visits) > atomic_load(&best->visits)) {
+            best = &mcts->root->children[i];
+        }
+    }
+    return(best->move);
+}
+bool mcts_is_decided(mcts_t *mcts) {
+    /*
+     * True once the most visited root move has at least twice the visits of the runner up, used by time management to decide if spending more time is worth it
+     */
+    if(atomic_load(&mcts->root->state) != mcts_expanded) {
+        return(true);
+    }
+    int64_t first = 0;
+    int64_t second = 0;
+    for(int64_t i = 0; i < mcts->root->child_count; i++) {
+        int64_t visits = atomic_load(&mcts->root->children[i].visits);
+        if(visits > first) {
+            second = first;
+            first = visits;
+        } else if(visits > second) {
+            second = visits;
+        }
+    }
+    return(first >= 2 * second);
+}
+long double mcts_evaluate_playout(mcts_worker_t *worker, board_t *board) {
+    enum color result;
+    for(int64_t ply = 0; ply < MCTS_PLAYOUT_MAX_PLIES; ply++) {
+        result = chess_board_random_move(board, worker->temp, &worker->rng);
+        if(result != c_e) {
+            return(result);
+        }
+        if(worker->mcts->stop != NULL && worker->mcts->stop(worker->mcts->stop_context)) {
+            return(NAN);
+        }
+    }
+    return(c_d);
+}
+long double mcts_evaluate_neuralnet(mcts_worker_t *worker, board_t *board) {
+    /*
+     * context has to be a neuralnet_t with its own activations, see neuralnet_share. The inputs are the same as for chess_moveindex_from_ai.
+     * The first output is whites score and gets squashed into [-1, 1]
+     */
+    neuralnet_t *net = worker->context;
+    nn_sparse_t features;
+    chess_board_encode(board, net, 0, &features);
+    chess_net_forward(net, &features, 1);
+    return(tanhl(MATRIX_AT(NN_OUTPUT(*net), 0, 0)));
+}
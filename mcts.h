@@ -0,0 +1,75 @@
+#ifndef MCTS_H
+#define MCTS_H
+
+#include "chess.h"
+#include "nn.h"
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#define MCTS_THREADS_MAX 64
+#define MCTS_NODES_DEFAULT (1 << 18)
+#define MCTS_C_PUCT 1.5
+#define MCTS_VALUE_SCALE 1000000 // Values are summed as fixed point so that they can be updated with plain atomic adds
+#define MCTS_PLAYOUT_MAX_PLIES 256
+
+enum mcts_state {
+    mcts_leaf = 0, mcts_expanding = 1, mcts_expanded = 2, mcts_terminal = 3, mcts_full = 4 // mcts_full is a leaf whose children did not fit into the node pool
+};
+
+typedef struct mcts_node {
+    move_t move; // The move that leads from the parent to this node
+    struct mcts_node *parent;
+    struct mcts_node *children;
+    int64_t child_count;
+    long double prior;
+    long double terminal_value; // From whites perspective, only valid in mcts_terminal
+    atomic_int state;
+    atomic_int_fast64_t visits;
+    atomic_int_fast64_t virtual_loss;
+    atomic_int_fast64_t value; // Sum of the results from the perspective of the side that played move, scaled by MCTS_VALUE_SCALE
+} mcts_node_t;
+
+struct mcts;
+
+typedef struct {
+    struct mcts *mcts;
+    board_t board;
+    move_t temp[MAXM];
+    uint64_t rng;
+    void *context; // Per thread state of the evaluator, e.g. a net with its own activations
+    int64_t playouts;
+} mcts_worker_t;
+
+// Returns the value of board from whites perspective in [-1, 1], or NAN if the evaluation was aborted because the search is stopping
+typedef long double (*mcts_evaluate_fn)(mcts_worker_t *worker, board_t *board);
+typedef bool (*mcts_stop_fn)(void *context);
+
+typedef struct mcts {
+    board_t root_board;
+    mcts_node_t *root;
+    mcts_node_t *nodes;
+    int64_t node_capacity;
+    atomic_int_fast64_t node_count;
+    int64_t thread_count;
+    mcts_worker_t workers[MCTS_THREADS_MAX];
+    mcts_evaluate_fn evaluate;
+    mcts_stop_fn stop;
+    void *stop_context;
+    int64_t playout_limit;
+    atomic_int_fast64_t playouts;
+    atomic_bool done;
+} mcts_t;
+
+extern mcts_t *mcts_alloc(int64_t node_capacity, int64_t thread_count, mcts_evaluate_fn evaluate, void **contexts);
+extern void mcts_free(mcts_t *mcts);
+extern void mcts_reset(mcts_t *mcts);
+extern void mcts_set_root(mcts_t *mcts, board_t *board);
+extern move_t mcts_search(mcts_t *mcts, int64_t playout_limit, mcts_stop_fn stop, void *stop_context);
+extern bool mcts_is_decided(mcts_t *mcts);
+
+extern long double mcts_evaluate_playout(mcts_worker_t *worker, board_t *board);
+extern long double mcts_evaluate_neuralnet(mcts_worker_t *worker, board_t *board);
+
+#endif
@@ -1,15 +1,22 @@
 #include "nn.h"
+#include "kernels.h"
+#include <fcntl.h>
+#include <pthread.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
-long double nn_relu(long double x) {
+nn_scalar_t nn_relu(nn_scalar_t x) {
     return x * (x >= 0);
 }
-long double nn_d_relu(long double x) {
+nn_scalar_t nn_d_relu(nn_scalar_t x) {
     return (x >= 0);
 }
-long double nn_sigmoid(long double x) {
-    return 1 / (1 + exp(-x));
+nn_scalar_t nn_sigmoid(nn_scalar_t x) {
+    return 1 / (1 + NN_EXP(-x));
 }
-long double nn_d_sigmoid(long double x) {
+nn_scalar_t nn_d_sigmoid(nn_scalar_t x) {
     return nn_sigmoid(x) * (1 - nn_sigmoid(x));
 }
 
@@ -18,29 +25,156 @@ long double nn_d_sigmoid(long double x) {
 ///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
 matrix_t matrix_malloc(uint64_t rows, uint64_t columns) {
+    kernels_init();
     matrix_t m;
     m.rows = rows;
     m.columns = columns;
     m.stride = columns;
-    m.values = (long double*)nn_malloc(sizeof(*m.values)*rows*columns);
+    m.values = (nn_scalar_t*)nn_malloc(sizeof(*m.values)*rows*columns);
     assert(m.values != NULL);
     return m;
 }
-void matrix_dot(matrix_t destination, matrix_t first, matrix_t second) {
-    assert(first.columns == second.rows);
-    assert(destination.rows == first.rows);
-    assert(destination.columns == second.columns);
-
-    uint64_t n = first.columns;
+// The packed panels of matrix_gemm, kept per thread and grown to the biggest blocks that thread has needed so far. Freed when the thread exits
+typedef struct {
+    nn_scalar_t *panels[2];
+    uint64_t sizes[2]; // in bytes
+} matrix_scratch_t;
+static pthread_key_t matrix_scratch_key;
+static pthread_once_t matrix_scratch_once = PTHREAD_ONCE_INIT;
+static void matrix_scratch_free(void *pointer) {
+    matrix_scratch_t *scratch = pointer;
+    free(scratch->panels[0]);
+    free(scratch->panels[1]);
+    free(scratch);
+}
+static void matrix_scratch_key_create(void) {
+    int error = pthread_key_create(&matrix_scratch_key, matrix_scratch_free);
+    assert(error == 0);
+    (void) error;
+}
+static nn_scalar_t *matrix_scratch(uint64_t panel, uint64_t size) {
+    pthread_once(&matrix_scratch_once, matrix_scratch_key_create);
+    matrix_scratch_t *scratch = pthread_getspecific(matrix_scratch_key);
+    if (scratch == NULL) {
+        scratch = (matrix_scratch_t*)calloc(1, sizeof(*scratch));
+        assert(scratch != NULL);
+        pthread_setspecific(matrix_scratch_key, scratch);
+    }
+    if (size > scratch->sizes[panel]) {
+        free(scratch->panels[panel]);
+        scratch->panels[panel] = (nn_scalar_t*)nn_malloc(size);
+        assert(scratch->panels[panel] != NULL);
+        scratch->sizes[panel] = size;
+    }
+    return scratch->panels[panel];
+}
+static void matrix_pack_first(nn_scalar_t *packed, matrix_t first, bool transposed, uint64_t row, uint64_t rows, uint64_t column, uint64_t depth) {
+    // Panels of NN_GEMM_MR rows stored column by column, rows past the end are zero so the kernel never needs to check.
+    // A transposed first is read in place, row + i + r is then a column of the stored matrix
+    for (uint64_t i = 0; i < rows; i += NN_GEMM_MR) {
+        for (uint64_t k = 0; k < depth; k++) {
+            for (uint64_t r = 0; r < NN_GEMM_MR; r++) {
+                if (i + r >= rows) {
+                    *packed++ = 0;
+                } else {
+                    *packed++ = transposed ? MATRIX_AT(first, column + k, row + i + r) : MATRIX_AT(first, row + i + r, column + k);
+                }
+            }
+        }
+    }
+}
+static void matrix_pack_second(nn_scalar_t *packed, matrix_t second, bool transposed, uint64_t row, uint64_t depth, uint64_t column, uint64_t columns) {
+    // Panels of NN_GEMM_NR columns stored row by row, zero padded and read in place like above
+    for (uint64_t j = 0; j < columns; j += NN_GEMM_NR) {
+        uint64_t width = columns - j < NN_GEMM_NR ? columns - j : NN_GEMM_NR;
+        for (uint64_t k = 0; k < depth; k++) {
+            uint64_t c = 0;
+            if (transposed) {
+                for (; c < width; c++) {
+                    *packed++ = MATRIX_AT(second, column + j + c, row + k);
+                }
+            } else {
+                nn_scalar_t *source = &MATRIX_AT(second, row + k, column + j);
+                for (; c < width; c++) {
+                    *packed++ = source[c];
+                }
+            }
+            for (; c < NN_GEMM_NR; c++) {
+                *packed++ = 0;
+            }
+        }
+    }
+}
+void matrix_gemm(matrix_t destination, matrix_t first, bool first_transposed, matrix_t second, bool second_transposed, bool accumulate) {
+    /*
+     * destination = op(first) . op(second), or destination += ... if accumulate, where op transposes its argument if the flag is set.
+     * Transposed operands are never copied, the packing reads them in place
+     */
+    uint64_t first_rows = first_transposed ? first.columns : first.rows;
+    uint64_t n = first_transposed ? first.rows : first.columns;
+    uint64_t second_rows = second_transposed ? second.columns : second.rows;
+    uint64_t second_columns = second_transposed ? second.rows : second.columns;
+    assert(n == second_rows);
+    assert(destination.rows == first_rows);
+    assert(destination.columns == second_columns);
 
-    for (uint64_t i = 0; i < destination.rows; i++) {
-        for (uint64_t j = 0; j < destination.columns; j++) {
-            MATRIX_AT(destination, i, j) = 0;
+    if (n == 0) {
+        if (!accumulate) {
+            matrix_fill(destination, 0);
+        }
+        return;
+    }
+    // Single rows (inference on one position) don't get anything out of packing, streaming through the rows of second is already cache friendly
+    if (destination.rows < NN_GEMM_MR && !second_transposed) {
+        for (uint64_t i = 0; i < destination.rows; i++) {
+            if (!accumulate) {
+                kernels.fill(&MATRIX_AT(destination, i, 0), 0, destination.columns);
+            }
             for (uint64_t k = 0; k < n; k++) {
-                MATRIX_AT(destination, i, j) += MATRIX_AT(first, i, k) * MATRIX_AT(second, k, j);
-            } 
+                nn_scalar_t a = first_transposed ? MATRIX_AT(first, k, i) : MATRIX_AT(first, i, k);
+                kernels.axpy(&MATRIX_AT(destination, i, 0), a, &MATRIX_AT(second, k, 0), destination.columns);
+            }
         }
+        return;
     }
+
+    uint64_t kc_max = n < NN_GEMM_KC ? n : NN_GEMM_KC;
+    uint64_t mc_max = destination.rows < NN_GEMM_MC ? destination.rows : NN_GEMM_MC;
+    uint64_t nc_max = destination.columns < NN_GEMM_NC ? destination.columns : NN_GEMM_NC;
+    uint64_t first_size = kc_max * ((mc_max + NN_GEMM_MR - 1) / NN_GEMM_MR * NN_GEMM_MR) * sizeof(nn_scalar_t);
+    uint64_t second_size = kc_max * ((nc_max + NN_GEMM_NR - 1) / NN_GEMM_NR * NN_GEMM_NR) * sizeof(nn_scalar_t);
+    nn_scalar_t *first_packed = matrix_scratch(0, first_size);
+    nn_scalar_t *second_packed = matrix_scratch(1, second_size);
+
+    for (uint64_t jc = 0; jc < destination.columns; jc += NN_GEMM_NC) {
+        uint64_t nc = destination.columns - jc < NN_GEMM_NC ? destination.columns - jc : NN_GEMM_NC;
+        for (uint64_t pc = 0; pc < n; pc += NN_GEMM_KC) {
+            uint64_t kc = n - pc < NN_GEMM_KC ? n - pc : NN_GEMM_KC;
+            matrix_pack_second(second_packed, second, second_transposed, pc, kc, jc, nc);
+            for (uint64_t ic = 0; ic < destination.rows; ic += NN_GEMM_MC) {
+                uint64_t mc = destination.rows - ic < NN_GEMM_MC ? destination.rows - ic : NN_GEMM_MC;
+                matrix_pack_first(first_packed, first, first_transposed, ic, mc, pc, kc);
+                for (uint64_t jr = 0; jr < nc; jr += NN_GEMM_NR) {
+                    for (uint64_t ir = 0; ir < mc; ir += NN_GEMM_MR) {
+                        kernels.dot(kc, &first_packed[ir * kc], &second_packed[jr * kc], &MATRIX_AT(destination, ic + ir, jc + jr), destination.stride,
+                                    mc - ir < NN_GEMM_MR ? mc - ir : NN_GEMM_MR, nc - jr < NN_GEMM_NR ? nc - jr : NN_GEMM_NR, accumulate || pc > 0);
+                    }
+                }
+            }
+        }
+    }
+}
+void matrix_dot(matrix_t destination, matrix_t first, matrix_t second) {
+    matrix_gemm(destination, first, false, second, false, false);
+}
+void matrix_dot_tn(matrix_t destination, matrix_t first, matrix_t second) {
+    matrix_gemm(destination, first, true, second, false, false);
+}
+void matrix_dot_nt(matrix_t destination, matrix_t first, matrix_t second) {
+    matrix_gemm(destination, first, false, second, true, false);
+}
+void matrix_dot_tt(matrix_t destination, matrix_t first, matrix_t second) {
+    matrix_gemm(destination, first, true, second, true, false);
 }
 matrix_t matrix_row(matrix_t first, uint64_t row) {
     return (matrix_t) {
@@ -50,14 +184,30 @@ matrix_t matrix_row(matrix_t first, uint64_t row) {
         .values = &MATRIX_AT(first, row, 0),
     };
 }
+matrix_t matrix_rows(matrix_t first, uint64_t row, uint64_t rows) {
+    assert(row + rows <= first.rows);
+    return (matrix_t) {
+        .rows = rows,
+        .columns = first.columns,
+        .stride = first.stride,
+        .values = &MATRIX_AT(first, row, 0),
+    };
+}
+matrix_t matrix_columns(matrix_t first, uint64_t column, uint64_t columns) {
+    assert(column + columns <= first.columns);
+    return (matrix_t) {
+        .rows = first.rows,
+        .columns = columns,
+        .stride = first.stride,
+        .values = &MATRIX_AT(first, 0, column),
+    };
+}
 void matrix_copy(matrix_t destination, matrix_t first) {
     assert(destination.rows == first.rows);
     //assert(destination.columns == first.columns);
 
     for (uint64_t i = 0; i < destination.rows; i++) {
-        for (uint64_t j = 0; j < destination.columns; j++) {
-            MATRIX_AT(destination, i, j) = MATRIX_AT(first, i, j);
-        }
+        kernels.copy(&MATRIX_AT(destination, i, 0), &MATRIX_AT(first, i, 0), destination.columns);
     }
 }
 void matrix_sum(matrix_t destination, matrix_t first) {
@@ -65,16 +215,69 @@ void matrix_sum(matrix_t destination, matrix_t first) {
     assert(destination.rows == first.rows);
 
     for (uint64_t i = 0; i < destination.rows; i++) {
-        for (uint64_t j = 0; j < destination.columns; j++) {
-            MATRIX_AT(destination, i, j) += MATRIX_AT(first, i, j);
+        kernels.add(&MATRIX_AT(destination, i, 0), &MATRIX_AT(first, i, 0), destination.columns);
+    }
+}
+void matrix_sum_broadcast(matrix_t destination, matrix_t first) {
+    // Adds the single row first to every row of destination, which is how the biases get applied to a whole batch
+    assert(destination.columns == first.columns);
+    assert(first.rows == 1);
+
+    for (uint64_t i = 0; i < destination.rows; i++) {
+        kernels.add(&MATRIX_AT(destination, i, 0), first.values, destination.columns);
+    }
+}
+void matrix_sum_rows(matrix_t destination, matrix_t first) {
+    // Adds every row of first to the single row of destination, the column sums that the bias gradients need
+    assert(destination.columns == first.columns);
+    assert(destination.rows == 1);
+
+    for (uint64_t i = 0; i < first.rows; i++) {
+        kernels.add(destination.values, &MATRIX_AT(first, i, 0), destination.columns);
+    }
+}
+void matrix_transpose(matrix_t destination, matrix_t first) {
+    assert(destination.rows == first.columns);
+    assert(destination.columns == first.rows);
+
+    // Square blocks so that both the reads and the writes stay within a few cache lines at a time
+    const uint64_t block = 16;
+    for (uint64_t i = 0; i < first.rows; i += block) {
+        for (uint64_t j = 0; j < first.columns; j += block) {
+            for (uint64_t k = i; k < i + block && k < first.rows; k++) {
+                for (uint64_t l = j; l < j + block && l < first.columns; l++) {
+                    MATRIX_AT(destination, l, k) = MATRIX_AT(first, k, l);
+                }
+            }
         }
     }
 }
+void matrix_axpy(matrix_t destination, nn_scalar_t alpha, matrix_t first) {
+    // destination += alpha * first
+    assert(destination.columns == first.columns);
+    assert(destination.rows == first.rows);
+
+    for (uint64_t i = 0; i < destination.rows; i++) {
+        kernels.axpy(&MATRIX_AT(destination, i, 0), alpha, &MATRIX_AT(first, i, 0), destination.columns);
+    }
+}
+void matrix_scale(matrix_t destination, nn_scalar_t alpha) {
+    for (uint64_t i = 0; i < destination.rows; i++) {
+        kernels.scale(&MATRIX_AT(destination, i, 0), alpha, destination.columns);
+    }
+}
 void matrix_activate(matrix_t destination) {
     for (uint64_t i = 0; i < destination.rows; i++) {
-        for (uint64_t j = 0; j < destination.columns; j++) {
-            MATRIX_AT(destination, i, j) = ACTIVATE(MATRIX_AT(destination, i, j));
-        }
+        kernels.activate(&MATRIX_AT(destination, i, 0), destination.columns);
+    }
+}
+void matrix_d_activate(matrix_t destination, matrix_t first) {
+    // destination *= D_ACTIVATE(first), which is how backprop moves a gradient back through the activation
+    assert(destination.columns == first.columns);
+    assert(destination.rows == first.rows);
+
+    for (uint64_t i = 0; i < destination.rows; i++) {
+        kernels.d_activate(&MATRIX_AT(destination, i, 0), &MATRIX_AT(first, i, 0), destination.columns);
     }
 }
 void matrix_print(matrix_t destination, const char *name, uint64_t padding) {
@@ -82,20 +285,18 @@ void matrix_print(matrix_t destination, const char *name, uint64_t padding) {
     for (uint64_t i = 0; i < destination.rows; i++) {
         printf("%*s    ", (int) padding, "");
         for (uint64_t j = 0; j < destination.columns; j++) {
-            printf("%Lf ", MATRIX_AT(destination, i, j));
+            printf("%Lf ", (long double) MATRIX_AT(destination, i, j));
         }
         printf("\n");
     }
     printf("%*s]\n", (int) padding, "");
 }
-void matrix_fill(matrix_t destination, long double filler) {
+void matrix_fill(matrix_t destination, nn_scalar_t filler) {
     for (uint64_t i = 0; i < destination.rows; i++) {
-        for (uint64_t j = 0; j < destination.columns; j++) {
-            MATRIX_AT(destination, i, j) = filler;
-        }
+        kernels.fill(&MATRIX_AT(destination, i, 0), filler, destination.columns);
     }
 }
-void matrix_random(matrix_t destination, long double bottom, long double top) {
+void matrix_random(matrix_t destination, nn_scalar_t bottom, nn_scalar_t top) {
     for (uint64_t i = 0; i < destination.rows; i++) {
         for (uint64_t j = 0; j < destination.columns; j++) {
             MATRIX_AT(destination, i, j) = NN_RAND_DOUBLE(bottom, top);
@@ -107,31 +308,145 @@ void matrix_random(matrix_t destination, long double bottom, long double top) {
 /// ---NEURALNET---
 ///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
+static uint64_t neuralnet_stride(uint64_t columns) {
+    return (columns + NN_ROW_PAD - 1) / NN_ROW_PAD * NN_ROW_PAD;
+}
+static matrix_t neuralnet_carve(nn_scalar_t **arena, uint64_t rows, uint64_t columns) {
+    matrix_t m = {
+        .rows = rows,
+        .columns = columns,
+        .stride = neuralnet_stride(columns),
+        .values = *arena,
+    };
+    *arena += rows * m.stride;
+    return m;
+}
+static neuralnet_t neuralnet_descriptors(uint64_t count) {
+    neuralnet_t net = {0};
+    net.count = count;
+    net.weights = (matrix_t*)malloc(sizeof(*net.weights) * (3 * count + 1));
+    assert(net.weights != NULL);
+    net.biases = net.weights + count;
+    net.activations = net.biases + count;
+    return net;
+}
 neuralnet_t neuralnet_malloc(uint64_t *architecture, uint64_t architecture_count) {
 
-    assert(architecture_count > 0);
+    assert(architecture_count > 1);
 
-    neuralnet_t net;
-    net.count = architecture_count - 1;
+    kernels_init();
 
-    net.weights = (matrix_t*)malloc(sizeof(*net.weights) * net.count);
-    net.biases = (matrix_t*)malloc(sizeof(*net.biases) * net.count);
-    net.activations = (matrix_t*)malloc(sizeof(*net.weights) * (net.count + 1));
-    assert(net.weights != NULL);
-    assert(net.biases != NULL);
-    assert(net.activations != NULL);
+    neuralnet_t net = neuralnet_descriptors(architecture_count - 1);
 
-    net.activations[0] = matrix_malloc(1, architecture[0]);
+    for (uint64_t i = 1; i < architecture_count; i++) {
+        net.parameter_size += (architecture[i-1] + 1) * neuralnet_stride(architecture[i]);
+    }
+    net.arena_size = net.parameter_size;
+    for (uint64_t i = 0; i < architecture_count; i++) {
+        net.arena_size += neuralnet_stride(architecture[i]);
+    }
+    net.arena = (nn_scalar_t*)nn_malloc(sizeof(*net.arena) * net.arena_size);
+    assert(net.arena != NULL);
+    // The padding has to be zero, the kernels never read it but a memcpy of the arena should be deterministic
+    memset(net.arena, 0, sizeof(*net.arena) * net.arena_size);
 
+    net.parameters = net.arena;
+    nn_scalar_t *next = net.arena;
     for (uint64_t i = 1; i < architecture_count; i++) {
-        net.weights[i-1] = matrix_malloc(net.activations[i-1].columns, architecture[i]);
-        net.biases[i-1] = matrix_malloc(1, architecture[i]);
-        net.activations[i] = matrix_malloc(1, architecture[i]);
+        net.weights[i-1] = neuralnet_carve(&next, architecture[i-1], architecture[i]);
+        net.biases[i-1] = neuralnet_carve(&next, 1, architecture[i]);
+    }
+    for (uint64_t i = 0; i < architecture_count; i++) {
+        net.activations[i] = neuralnet_carve(&next, 1, architecture[i]);
     }
 
     return net;
 }
-void neuralnet_fill(neuralnet_t net, long double fill) {
+neuralnet_t neuralnet_malloc_like(neuralnet_t net) {
+    // Same architecture as net, with its own weights and biases. This is what a gradient for net looks like
+    uint64_t *architecture = (uint64_t*)malloc(sizeof(*architecture) * (net.count + 1));
+    assert(architecture != NULL);
+    architecture[0] = net.weights[0].rows;
+    for (uint64_t i = 0; i < net.count; i++) {
+        architecture[i+1] = net.weights[i].columns;
+    }
+    neuralnet_t like = neuralnet_malloc(architecture, net.count + 1);
+    free(architecture);
+    return like;
+}
+void neuralnet_free(neuralnet_t net) {
+    // Works for nets, batches and loaded nets alike, only the owner of a file mapping has it set
+    if (net.mapping != NULL) {
+        munmap(net.mapping, net.mapping_size);
+    }
+    free(net.arena);
+    free(net.weights);
+}
+neuralnet_t neuralnet_clone(neuralnet_t net) {
+    // A net of its own with the parameters and activations of net, also turns a loaded net into one that can be trained
+    assert(net.parameter_size > 0);
+    uint64_t activation_size = 0;
+    for (uint64_t i = 0; i <= net.count; i++) {
+        activation_size += net.activations[i].rows * net.activations[i].stride;
+    }
+    neuralnet_t clone = neuralnet_descriptors(net.count);
+    clone.parameter_size = net.parameter_size;
+    clone.arena_size = net.parameter_size + activation_size;
+    clone.arena = (nn_scalar_t*)nn_malloc(sizeof(*clone.arena) * clone.arena_size);
+    assert(clone.arena != NULL);
+    clone.parameters = clone.arena;
+    memcpy(clone.arena, net.parameters, sizeof(*clone.arena) * net.parameter_size);
+    memcpy(clone.arena + net.parameter_size, NN_INPUT(net).values, sizeof(*clone.arena) * activation_size);
+    for (uint64_t i = 0; i < net.count; i++) {
+        clone.weights[i] = net.weights[i];
+        clone.weights[i].values = clone.parameters + (net.weights[i].values - net.parameters);
+        clone.biases[i] = net.biases[i];
+        clone.biases[i].values = clone.parameters + (net.biases[i].values - net.parameters);
+    }
+    for (uint64_t i = 0; i <= net.count; i++) {
+        clone.activations[i] = net.activations[i];
+        clone.activations[i].values = clone.arena + net.parameter_size + (net.activations[i].values - NN_INPUT(net).values);
+    }
+    return clone;
+}
+void neuralnet_copy(neuralnet_t destination, neuralnet_t source) {
+    // Copies the weights and biases between two nets of the same architecture
+    assert(destination.parameter_size == source.parameter_size);
+    assert(source.parameter_size > 0);
+    assert(destination.mapping == NULL);
+    memcpy(destination.parameters, source.parameters, sizeof(*source.parameters) * source.parameter_size);
+}
+neuralnet_t neuralnet_share(neuralnet_t net) {
+    // Same weights and biases as net but its own activations, so that several threads can run forward passes of one net at the same time
+    return neuralnet_batch(net, NN_INPUT(net).rows);
+}
+neuralnet_t neuralnet_batch(neuralnet_t net, uint64_t rows) {
+    // Shares the weights and biases of net, with activations that hold rows samples at once. Every layer of a forward pass is then one GEMM that reuses each weight rows times
+    assert(rows > 0);
+    neuralnet_t batch = neuralnet_descriptors(net.count);
+    batch.parameters = net.parameters;
+    batch.parameter_size = net.parameter_size;
+    for (uint64_t i = 0; i < net.count; i++) {
+        batch.weights[i] = net.weights[i];
+        batch.biases[i] = net.biases[i];
+    }
+    for (uint64_t i = 0; i <= net.count; i++) {
+        batch.arena_size += rows * neuralnet_stride(net.activations[i].columns);
+    }
+    batch.arena = (nn_scalar_t*)nn_malloc(sizeof(*batch.arena) * batch.arena_size);
+    assert(batch.arena != NULL);
+    memset(batch.arena, 0, sizeof(*batch.arena) * batch.arena_size);
+    nn_scalar_t *next = batch.arena;
+    for (uint64_t i = 0; i <= net.count; i++) {
+        batch.activations[i] = neuralnet_carve(&next, rows, net.activations[i].columns);
+    }
+    return batch;
+}
+void neuralnet_batch_free(neuralnet_t batch) {
+    // Only the activations, the weights and biases belong to the net the batch was made from
+    neuralnet_free(batch);
+}
+void neuralnet_fill(neuralnet_t net, nn_scalar_t fill) {
     for (uint64_t i = 0; i < net.count; i++) {
         matrix_fill(net.weights[i], fill);
         matrix_fill(net.biases[i], fill);
@@ -152,98 +467,243 @@ void neuralnet_nudge(neuralnet_t net, neuralnet_t nudge) {
         matrix_sum(net.biases[i], nudge.biases[i]);
     }
 }
+static uint64_t neuralnet_noise_hash(uint64_t x) {
+    // splitmix64, a counter based generator so that any value of a noise stream can be computed on its own
+    x += 0x9E3779B97F4A7C15ULL;
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+    return x ^ (x >> 31);
+}
+void neuralnet_perturb(neuralnet_t destination, neuralnet_t source, uint64_t seed, nn_scalar_t scale) {
+    /*
+     * destination = source + scale * noise, the seeded and thread safe counterpart of neuralnet_nudge. The noise is standard normal and only depends
+     * on seed and the offset of each parameter in the arena, so it never has to be stored: the same seed gives it back and -scale gives the antithetic twin.
+     * destination may be source
+     */
+    assert(destination.parameter_size == source.parameter_size);
+    // The descriptors of the biases directly follow the ones of the weights
+    for (uint64_t i = 0; i < 2 * source.count; i++) {
+        matrix_t from = source.weights[i];
+        matrix_t to = destination.weights[i];
+        for (uint64_t r = 0; r < from.rows; r++) {
+            uint64_t offset = &MATRIX_AT(from, r, 0) - source.parameters;
+            for (uint64_t j = 0; j < from.columns; j++) {
+                uint64_t a = neuralnet_noise_hash(seed ^ neuralnet_noise_hash(2 * (offset + j)));
+                uint64_t b = neuralnet_noise_hash(seed ^ neuralnet_noise_hash(2 * (offset + j) + 1));
+                // Box-Muller, u is in (0, 1] so the log is finite
+                double u = ((a >> 11) + 1) * 0x1.0p-53;
+                double v = (b >> 11) * 0x1.0p-53;
+                MATRIX_AT(to, r, j) = MATRIX_AT(from, r, j) + scale * sqrt(-2 * log(u)) * cos(6.283185307179586 * v);
+            }
+        }
+    }
+}
 void neuralnet_forward(neuralnet_t net) {
-    for (uint64_t i = 0; i < net.count; i++) {
-        matrix_dot(net.activations[i+1], net.activations[i], net.weights[i]);
-        matrix_sum(net.activations[i+1], net.biases[i]);
-        matrix_activate(net.activations[i+1]);
+    neuralnet_forward_rows(net, NN_INPUT(net).rows);
+}
+static void neuralnet_forward_layers(neuralnet_t net, uint64_t rows, uint64_t first) {
+    for (uint64_t i = first; i < net.count; i++) {
+        matrix_t output = matrix_rows(net.activations[i+1], 0, rows);
+        matrix_dot(output, matrix_rows(net.activations[i], 0, rows), net.weights[i]);
+        matrix_sum_broadcast(output, net.biases[i]);
+        matrix_activate(output);
     }
 }
-long double neuralnet_cost(neuralnet_t net, matrix_t input, matrix_t output) {
+void neuralnet_forward_rows(neuralnet_t net, uint64_t rows) {
+    // Only runs the first rows rows of the activations, so that a partially filled batch doesn't pay for the rest
+    assert(rows <= NN_INPUT(net).rows);
+    neuralnet_forward_layers(net, rows, 0);
+}
+void neuralnet_predict(neuralnet_t net, matrix_t input, matrix_t output) {
+    // Runs every row of input through net and writes the results to the same row of output, as many rows per forward pass as the activations of net hold
     assert(input.rows == output.rows);
+    assert(output.columns == NN_OUTPUT(net).columns);
 
-    uint64_t num = input.rows;
+    uint64_t capacity = NN_INPUT(net).rows;
+    for (uint64_t i = 0; i < input.rows; i += capacity) {
+        uint64_t rows = input.rows - i < capacity ? input.rows - i : capacity;
+        matrix_copy(matrix_rows(NN_INPUT(net), 0, rows), matrix_rows(input, i, rows));
+        neuralnet_forward_rows(net, rows);
+        matrix_copy(matrix_rows(output, i, rows), matrix_rows(NN_OUTPUT(net), 0, rows));
+    }
+}
+nn_scalar_t neuralnet_cost(neuralnet_t net, matrix_t input, matrix_t output) {
+    assert(input.rows == output.rows);
 
-    long double cost = 0;
+    uint64_t num = input.rows;
 
-    for (uint64_t i = 0; i < num; i++) {
-        matrix_t x = matrix_row(input, i);
-        matrix_t y = matrix_row(output, i);
+    nn_scalar_t cost = 0;
 
-        matrix_copy(NN_INPUT(net), x);
-        neuralnet_forward(net);
+    neuralnet_t batch = neuralnet_batch(net, num < NN_BATCH_ROWS ? (num > 0 ? num : 1) : NN_BATCH_ROWS);
+    for (uint64_t i = 0; i < num; i += NN_INPUT(batch).rows) {
+        uint64_t rows = num - i < NN_INPUT(batch).rows ? num - i : NN_INPUT(batch).rows;
+        matrix_copy(matrix_rows(NN_INPUT(batch), 0, rows), matrix_rows(input, i, rows));
+        neuralnet_forward_rows(batch, rows);
         uint64_t q = output.columns;
-        for (uint64_t j = 0; j < q; j++) {
-            float difference = MATRIX_AT(NN_OUTPUT(net), 0, j) - MATRIX_AT(y, 0, j);
-            cost += difference * difference;
+        for (uint64_t r = 0; r < rows; r++) {
+            for (uint64_t j = 0; j < q; j++) {
+                nn_scalar_t difference = MATRIX_AT(NN_OUTPUT(batch), r, j) - MATRIX_AT(output, i + r, j);
+                cost += difference * difference;
+            }
         }
     }
+    neuralnet_batch_free(batch);
 
     return cost/num;
 }
 void neuralnet_backprop(neuralnet_t net, neuralnet_t gradient, matrix_t input, matrix_t output) {
-    assert(input.columns == output.columns);
+    // neuralnet_backprop_batch with workspaces that only live for this call, callers that backprop over and over should keep their own
+    uint64_t num = input.rows;
+    uint64_t capacity = num < NN_BATCH_ROWS ? (num > 0 ? num : 1) : NN_BATCH_ROWS;
+
+    neuralnet_t forward = neuralnet_batch(net, capacity);
+    neuralnet_t backward = neuralnet_batch(gradient, capacity);
+    neuralnet_backprop_batch(net, gradient, forward, backward, input, output);
+    neuralnet_batch_free(forward);
+    neuralnet_batch_free(backward);
+}
+void neuralnet_backprop_batch(neuralnet_t net, neuralnet_t gradient, neuralnet_t forward, neuralnet_t backward, matrix_t input, matrix_t output) {
+    /*
+     * Mini batch backprop in matrix form, as many samples at a time as the workspaces hold. For every layer, going backwards
+     *     dZ     = dA * D_ACTIVATE(A)
+     *     dW    += A_prev^T . dZ
+     *     db    += column sums of dZ
+     *     dA_prev = dZ . W^T
+     * The forward activations live in forward, a batch of net, the dA and dZ in backward, a batch of gradient with the same rows, which makes them the same shapes.
+     * Both transposed products read their operands in place, see matrix_gemm
+     */
+    assert(input.rows == output.rows);
+    assert(output.columns == NN_OUTPUT(net).columns);
+    assert(NN_INPUT(forward).rows == NN_INPUT(backward).rows);
 
     uint64_t num = input.rows;
+    uint64_t capacity = NN_INPUT(forward).rows;
 
     neuralnet_fill(gradient, 0);
 
-    for (uint64_t i = 0; i < num; i++) {
-        matrix_copy(NN_INPUT(net), matrix_row(input, i));
-        neuralnet_forward(net);
+    for (uint64_t i = 0; i < num; i += capacity) {
+        uint64_t rows = num - i < capacity ? num - i : capacity;
+        matrix_copy(matrix_rows(NN_INPUT(forward), 0, rows), matrix_rows(input, i, rows));
+        neuralnet_forward_rows(forward, rows);
 
-        for (uint64_t j = 0; j <= net.count; j++) {
-            matrix_fill(gradient.activations[j], 0);
-        }
+        matrix_t d_output = matrix_rows(NN_OUTPUT(backward), 0, rows);
+        matrix_copy(d_output, matrix_rows(NN_OUTPUT(forward), 0, rows));
+        matrix_axpy(d_output, -1, matrix_rows(output, i, rows));
+        matrix_scale(d_output, 2);
 
-        for (uint64_t j = 0; j < output.columns; j++) {
-            MATRIX_AT(NN_OUTPUT(gradient), 0, j) = 2 * (MATRIX_AT(NN_OUTPUT(net), 0, j) - MATRIX_AT(output, i, j));
-        }
+        for (uint64_t l = net.count; l > 0; l--) {
+            matrix_t d_z = matrix_rows(backward.activations[l], 0, rows);
+            matrix_d_activate(d_z, matrix_rows(forward.activations[l], 0, rows));
 
-        long double s = 1;
+            matrix_gemm(gradient.weights[l - 1], matrix_rows(forward.activations[l - 1], 0, rows), true, d_z, false, true);
+            matrix_sum_rows(gradient.biases[l - 1], d_z);
 
-        for (uint64_t l = net.count; l > 0; l--) {
-            for (uint64_t j = 0; j < net.activations[l].columns; j++) {
-                long double a = MATRIX_AT(net.activations[l], 0, j);
-                long double d_a = MATRIX_AT(gradient.activations[l], 0, j);
-                long double q_a = D_ACTIVATE(a);
-                MATRIX_AT(gradient.biases[l - 1], 0, j) += s * d_a * q_a;
-                for (uint64_t k = 0; k < net.activations[l - 1].columns; k++) {
-                    long double p_a = MATRIX_AT(net.activations[l - 1], 0, k);
-                    long double w = MATRIX_AT(net.weights[l - 1],k ,j);
-                    MATRIX_AT(gradient.weights[l - 1], k, j) += s * d_a * q_a * p_a;
-                    MATRIX_AT(gradient.activations[l-1], 0, k) += s * d_a * q_a * w;
-                }
+            if (l > 1) {
+                matrix_dot_nt(matrix_rows(backward.activations[l - 1], 0, rows), d_z, net.weights[l - 1]);
             }
         }
     }
 
     for (uint64_t i = 0; i < gradient.count; i++) {
-        for (uint64_t j = 0; j < gradient.weights[i].rows; j++) {
-            for (uint64_t k = 0; k < gradient.weights[i].columns; k++) {
-                MATRIX_AT(gradient.weights[i], j, k) /= num;
-            }
-        }
-        for (uint64_t j = 0; j < gradient.biases[i].rows; j++) {
-            for (uint64_t k = 0; k < gradient.biases[i].columns; k++) {
-                MATRIX_AT(gradient.biases[i], j, k) /= num;
-            }
-        }
+        matrix_scale(gradient.weights[i], (nn_scalar_t) 1 / num);
+        matrix_scale(gradient.biases[i], (nn_scalar_t) 1 / num);
     }
 }
-void neuralnet_learn(neuralnet_t net, neuralnet_t gradient, long double rate) {
+void neuralnet_learn(neuralnet_t net, neuralnet_t gradient, nn_scalar_t rate) {
     for (uint64_t i = 0; i < net.count; i++) {
-        for (uint64_t j = 0; j < net.weights[i].rows; j++) {
-            for (uint64_t k = 0; k < net.weights[i].columns; k++) {
-                MATRIX_AT(net.weights[i], j, k) -= rate * MATRIX_AT(gradient.weights[i], j, k);
-            }
+        matrix_axpy(net.weights[i], -rate, gradient.weights[i]);
+        matrix_axpy(net.biases[i], -rate, gradient.biases[i]);
+    }
+}
+void neuralnet_forward_sparse(neuralnet_t net, const nn_sparse_t *input, uint64_t rows) {
+    /*
+     * Forward pass for rows one hot samples. The first layer of a one hot input is just the bias plus the weight rows of the active features,
+     * which for a board is at most 32 row additions instead of a product with 768 mostly zero inputs. NN_INPUT(net) is not used
+     */
+    assert(rows <= NN_INPUT(net).rows);
+    for (uint64_t r = 0; r < rows; r++) {
+        matrix_t output = matrix_row(net.activations[1], r);
+        matrix_copy(output, net.biases[0]);
+        for (uint64_t k = 0; k < input[r].count; k++) {
+            assert(input[r].features[k] < net.weights[0].rows);
+            matrix_sum(output, matrix_row(net.weights[0], input[r].features[k]));
         }
-        for (uint64_t j = 0; j < net.biases[i].rows; j++) {
-            for (uint64_t k = 0; k < net.biases[i].columns; k++) {
-                MATRIX_AT(net.biases[i], j, k) -= rate * MATRIX_AT(gradient.biases[i], j, k);
+    }
+    neuralnet_forward_hidden(net, rows);
+}
+void neuralnet_forward_hidden(neuralnet_t net, uint64_t rows) {
+    // Finishes a forward pass whose first layer pre activations are already in activations[1], see neuralnet_forward_sparse and accumulator_store
+    assert(rows <= NN_INPUT(net).rows);
+    matrix_activate(matrix_rows(net.activations[1], 0, rows));
+    neuralnet_forward_layers(net, rows, 1);
+}
+void neuralnet_backprop_sparse(neuralnet_t net, neuralnet_t gradient, const nn_sparse_t *input, matrix_t output) {
+    /*
+     * neuralnet_backprop for one hot samples. The gradient of the first weights only has rows for features that were active in the batch,
+     * so those rows are the only ones written. That relies on every other row of gradient.weights[0] being 0, which a fresh gradient is and which
+     * neuralnet_learn_sparse restores after applying it. The 1 / num of the mean is folded into dA of the output so no row needs a second pass
+     */
+    assert(output.columns == NN_OUTPUT(net).columns);
+
+    uint64_t num = output.rows;
+    uint64_t capacity = num < NN_BATCH_ROWS ? (num > 0 ? num : 1) : NN_BATCH_ROWS;
+
+    matrix_fill(gradient.biases[0], 0);
+    for (uint64_t i = 1; i < gradient.count; i++) {
+        matrix_fill(gradient.weights[i], 0);
+        matrix_fill(gradient.biases[i], 0);
+    }
+
+    neuralnet_t forward = neuralnet_batch(net, capacity);
+    neuralnet_t backward = neuralnet_batch(gradient, capacity);
+
+    for (uint64_t i = 0; i < num; i += capacity) {
+        uint64_t rows = num - i < capacity ? num - i : capacity;
+        neuralnet_forward_sparse(forward, input + i, rows);
+
+        matrix_t d_output = matrix_rows(NN_OUTPUT(backward), 0, rows);
+        matrix_copy(d_output, matrix_rows(NN_OUTPUT(forward), 0, rows));
+        matrix_axpy(d_output, -1, matrix_rows(output, i, rows));
+        matrix_scale(d_output, (nn_scalar_t) 2 / num);
+
+        for (uint64_t l = net.count; l > 0; l--) {
+            matrix_t d_z = matrix_rows(backward.activations[l], 0, rows);
+            matrix_d_activate(d_z, matrix_rows(forward.activations[l], 0, rows));
+            matrix_sum_rows(gradient.biases[l - 1], d_z);
+
+            if (l > 1) {
+                matrix_gemm(gradient.weights[l - 1], matrix_rows(forward.activations[l - 1], 0, rows), true, d_z, false, true);
+                matrix_dot_nt(matrix_rows(backward.activations[l - 1], 0, rows), d_z, net.weights[l - 1]);
+            } else {
+                for (uint64_t r = 0; r < rows; r++) {
+                    for (uint64_t k = 0; k < input[i + r].count; k++) {
+                        matrix_sum(matrix_row(gradient.weights[0], input[i + r].features[k]), matrix_row(d_z, r));
+                    }
+                }
             }
         }
     }
+
+    neuralnet_batch_free(forward);
+    neuralnet_batch_free(backward);
+}
+void neuralnet_learn_sparse(neuralnet_t net, neuralnet_t gradient, const nn_sparse_t *input, uint64_t rows, nn_scalar_t rate) {
+    /*
+     * neuralnet_learn for a gradient from neuralnet_backprop_sparse over the same input. Every first layer row is applied and then zeroed,
+     * so a feature that shows up in many samples is applied once and the gradient is ready for the next batch
+     */
+    for (uint64_t r = 0; r < rows; r++) {
+        for (uint64_t k = 0; k < input[r].count; k++) {
+            matrix_t row = matrix_row(gradient.weights[0], input[r].features[k]);
+            matrix_axpy(matrix_row(net.weights[0], input[r].features[k]), -rate, row);
+            matrix_fill(row, 0);
+        }
+    }
+    matrix_axpy(net.biases[0], -rate, gradient.biases[0]);
+    for (uint64_t i = 1; i < net.count; i++) {
+        matrix_axpy(net.weights[i], -rate, gradient.weights[i]);
+        matrix_axpy(net.biases[i], -rate, gradient.biases[i]);
+    }
 }
 void neuralnet_print(neuralnet_t net, const char *name) {
     char buf[256];
@@ -258,26 +718,230 @@ void neuralnet_print(neuralnet_t net, const char *name) {
 }
 
 ///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
-/// ---BATCHES---
+/// ---FILES---
 ///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
-batch batch_malloc(uint64_t batch_size, uint64_t input_size, uint64_t output_size) {
-    batch b;
-    b.input = matrix_malloc(input_size, batch_size);
-    b.output = matrix_malloc(output_size, batch_size);
-    return b;
+static uint64_t neuralnet_parameter_offset(uint64_t count) {
+    // The header, the architecture and one activation per layer, padded so that the parameters start on a cache line
+    uint64_t size = sizeof(nn_model_header_t) + sizeof(uint64_t) * (count + 1) + sizeof(uint32_t) * count;
+    return (size + NN_ALIGN - 1) / NN_ALIGN * NN_ALIGN;
 }
-void batch_make(batch batch, uint64_t batch_size, uint64_t input_size, uint64_t output_size, matrix_t input, matrix_t output) {
-    uint64_t x;
-    for (uint64_t i = 0; i < batch_size; i++) {
-        x = (rand() % (batch_size + 1));
-        for (uint64_t j = 0; j < input_size; j++) {
-            MATRIX_AT(batch.input, j, i) = MATRIX_AT(input, j, x);
+bool neuralnet_save(neuralnet_t net, const char *path) {
+    /*
+     * The layout of a model file is
+     *     nn_model_header_t
+     *     uint64_t architecture[count + 1]
+     *     uint32_t activation[count], the NN_ACTIVATION of every layer
+     *     zeros up to parameter_offset
+     *     the parameters exactly as they are in the arena, rows padded to NN_ROW_PAD
+     * so that neuralnet_load can use the parameters straight from the mapping
+     */
+    assert(net.parameter_size > 0);
+    FILE *file = fopen(path, "wb");
+    if (file == NULL) {
+        fprintf(stderr, "ERROR: Could not open %s for writing\n", path);
+        return false;
+    }
+    nn_model_header_t header = {
+        .magic = NN_MODEL_MAGIC,
+        .version = NN_MODEL_VERSION,
+        .scalar_size = sizeof(nn_scalar_t),
+        .count = net.count,
+        .parameter_offset = neuralnet_parameter_offset(net.count),
+        .parameter_size = net.parameter_size,
+    };
+    bool ok = fwrite(&header, sizeof(header), 1, file) == 1;
+    uint64_t offset = sizeof(header);
+    for (uint64_t i = 0; i <= net.count && ok; i++) {
+        uint64_t size = i == 0 ? net.weights[0].rows : net.weights[i-1].columns;
+        ok = fwrite(&size, sizeof(size), 1, file) == 1;
+        offset += sizeof(size);
+    }
+    for (uint64_t i = 0; i < net.count && ok; i++) {
+        uint32_t activation = NN_ACTIVATION;
+        ok = fwrite(&activation, sizeof(activation), 1, file) == 1;
+        offset += sizeof(activation);
+    }
+    for (; offset < header.parameter_offset && ok; offset++) {
+        ok = fputc(0, file) != EOF;
+    }
+    if (ok) {
+        ok = fwrite(net.parameters, sizeof(*net.parameters), net.parameter_size, file) == net.parameter_size;
+    }
+    if (fclose(file) != 0) {
+        ok = false;
+    }
+    if (!ok) {
+        fprintf(stderr, "ERROR: Could not write %s\n", path);
+    }
+    return ok;
+}
+bool neuralnet_load(neuralnet_t *net, const char *path) {
+    /*
+     * Maps the file read only and shared, the weights and biases point straight into the mapping. Nothing is read up front,
+     * every process that loads the same file shares the same page cache pages. The activations get an arena of their own like a batch with one row.
+     * Writing to the parameters of a loaded net faults, neuralnet_clone it to train
+     */
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        fprintf(stderr, "ERROR: Could not open %s\n", path);
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (uint64_t) st.st_size < sizeof(nn_model_header_t)) {
+        fprintf(stderr, "ERROR: %s is not a model file\n", path);
+        close(fd);
+        return false;
+    }
+    uint64_t mapping_size = st.st_size;
+    void *mapping = mmap(NULL, mapping_size, PROT_READ, MAP_SHARED, fd, 0);
+    // The mapping keeps the file alive on its own
+    close(fd);
+    if (mapping == MAP_FAILED) {
+        fprintf(stderr, "ERROR: Could not map %s\n", path);
+        return false;
+    }
+
+    const nn_model_header_t *header = mapping;
+    const char *error = NULL;
+    if (memcmp(header->magic, NN_MODEL_MAGIC, sizeof(header->magic)) != 0) {
+        error = "is not a model file";
+    } else if (header->version != NN_MODEL_VERSION) {
+        error = "has an unsupported version";
+    } else if (header->scalar_size != sizeof(nn_scalar_t)) {
+        error = "was saved by a build with a different nn_scalar_t";
+    } else if (header->count == 0 || header->count > mapping_size || header->parameter_offset != neuralnet_parameter_offset(header->count) || header->parameter_offset > mapping_size) {
+        error = "has a broken header";
+    }
+
+    const uint64_t *architecture = NULL;
+    if (error == NULL) {
+        architecture = (const uint64_t*)(header + 1);
+        const uint32_t *activation = (const uint32_t*)(architecture + header->count + 1);
+        uint64_t parameter_size = 0;
+        for (uint64_t i = 1; i <= header->count; i++) {
+            parameter_size += (architecture[i-1] + 1) * neuralnet_stride(architecture[i]);
+        }
+        for (uint64_t i = 0; i < header->count; i++) {
+            if (activation[i] != NN_ACTIVATION) {
+                error = "uses an activation this build was not compiled for";
+            }
         }
-        for (uint64_t j = 0; j < output_size; j++) {
-            MATRIX_AT(batch.output, j, i) = MATRIX_AT(output, j, x);
+        if (parameter_size != header->parameter_size || parameter_size > (mapping_size - header->parameter_offset) / sizeof(nn_scalar_t)) {
+            error = "is truncated or has a broken architecture";
         }
     }
+    if (error != NULL) {
+        fprintf(stderr, "ERROR: %s %s\n", path, error);
+        munmap(mapping, mapping_size);
+        return false;
+    }
+
+    kernels_init();
+
+    *net = neuralnet_descriptors(header->count);
+    net->mapping = mapping;
+    net->mapping_size = mapping_size;
+    net->parameters = (nn_scalar_t*)((char*)mapping + header->parameter_offset);
+    net->parameter_size = header->parameter_size;
+    nn_scalar_t *next = net->parameters;
+    for (uint64_t i = 1; i <= net->count; i++) {
+        net->weights[i-1] = neuralnet_carve(&next, architecture[i-1], architecture[i]);
+        net->biases[i-1] = neuralnet_carve(&next, 1, architecture[i]);
+    }
+    for (uint64_t i = 0; i <= net->count; i++) {
+        net->arena_size += neuralnet_stride(architecture[i]);
+    }
+    net->arena = (nn_scalar_t*)nn_malloc(sizeof(*net->arena) * net->arena_size);
+    assert(net->arena != NULL);
+    memset(net->arena, 0, sizeof(*net->arena) * net->arena_size);
+    next = net->arena;
+    for (uint64_t i = 0; i <= net->count; i++) {
+        net->activations[i] = neuralnet_carve(&next, 1, architecture[i]);
+    }
+    return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// ---ACCUMULATOR---
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+accumulator_t *accumulator_alloc(neuralnet_t net, uint64_t plies) {
+    // plies is how many pushes deep the accumulator can go, so the longest line that gets made on top of the position it was refreshed with
+    assert(net.count > 1);
+    assert(plies > 0);
+    accumulator_t *accumulator = malloc(sizeof(*accumulator));
+    assert(accumulator != NULL);
+    accumulator->net = neuralnet_batch(net, 1);
+    accumulator->stack = matrix_malloc(plies + 1, net.biases[0].columns);
+    accumulator->ply = 0;
+    accumulator_refresh(accumulator, &(nn_sparse_t) {0});
+    return accumulator;
+}
+void accumulator_free(accumulator_t *accumulator) {
+    neuralnet_batch_free(accumulator->net);
+    free(accumulator->stack.values);
+    free(accumulator);
+}
+void accumulator_refresh(accumulator_t *accumulator, const nn_sparse_t *input) {
+    // Computes the accumulator of input from scratch and makes it the bottom of the stack
+    accumulator->ply = 0;
+    matrix_t row = matrix_row(accumulator->stack, 0);
+    matrix_copy(row, accumulator->net.biases[0]);
+    for (uint64_t k = 0; k < input->count; k++) {
+        matrix_sum(row, matrix_row(accumulator->net.weights[0], input->features[k]));
+    }
+}
+void accumulator_push(accumulator_t *accumulator, const uint16_t *added, uint64_t added_count, const uint16_t *removed, uint64_t removed_count) {
+    /*
+     * The next ply is the current one with the rows of the added features added and the ones of the removed features subtracted.
+     * A move changes at most 4 features, so this is a handful of row operations instead of the whole first layer
+     */
+    if (accumulator->ply + 1 >= accumulator->stack.rows) {
+        fprintf(stderr, "ERROR: Accumulator is full after %lu plies\n", accumulator->ply);
+        exit(1);
+    }
+    matrix_t weights = accumulator->net.weights[0];
+    matrix_t row = matrix_row(accumulator->stack, accumulator->ply + 1);
+    matrix_copy(row, matrix_row(accumulator->stack, accumulator->ply));
+    for (uint64_t k = 0; k < added_count; k++) {
+        matrix_sum(row, matrix_row(weights, added[k]));
+    }
+    for (uint64_t k = 0; k < removed_count; k++) {
+        matrix_axpy(row, -1, matrix_row(weights, removed[k]));
+    }
+    accumulator->ply++;
+}
+void accumulator_pop(accumulator_t *accumulator) {
+    assert(accumulator->ply > 0);
+    accumulator->ply--;
+}
+void accumulator_store(accumulator_t *accumulator, neuralnet_t net, uint64_t row) {
+    // Copies the current pre activations into a row of a batch of the same net, so that many positions can share one neuralnet_forward_hidden
+    matrix_copy(matrix_row(net.activations[1], row), matrix_row(accumulator->stack, accumulator->ply));
+}
+matrix_t accumulator_forward(accumulator_t *accumulator) {
+    // Only the layers above the first one are computed. The returned row is overwritten by the next call
+    matrix_t first = accumulator->net.activations[1];
+    matrix_copy(first, matrix_row(accumulator->stack, accumulator->ply));
+    matrix_activate(first);
+    neuralnet_forward_layers(accumulator->net, 1, 1);
+    return NN_OUTPUT(accumulator->net);
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// ---BATCHES---
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+batch batch_malloc(uint64_t rows, uint64_t input_columns, uint64_t output_columns) {
+    batch b;
+    b.input = matrix_malloc(rows, input_columns);
+    b.output = matrix_malloc(rows, output_columns);
+    return b;
+}
+void batch_free(batch b) {
+    free(b.input.values);
+    free(b.output.values);
 }
 void batch_print(batch b, const char *name) {
     printf("%s = [\n", name);
@@ -285,3 +949,87 @@ void batch_print(batch b, const char *name) {
     matrix_print(b.output, "batch_output", 4);
     printf("]\n");
 }
+static uint64_t sampler_rand(uint64_t *state) {
+    // xorshift64*, like chess_rand, so that a sampler has its own reproducible stream and doesn't touch rand()
+    *state ^= *state >> 12;
+    *state ^= *state << 25;
+    *state ^= *state >> 27;
+    return *state * 0x2545F4914F6CDD1DULL;
+}
+static void sampler_shuffle(sampler_t *sampler) {
+    // Fisher-Yates, the small modulo bias of 64 bit random numbers doesn't matter for the sizes of data sets
+    for (uint64_t i = sampler->input.rows - 1; i > 0; i--) {
+        uint64_t j = sampler_rand(&sampler->rng) % (i + 1);
+        uint64_t t = sampler->order[i];
+        sampler->order[i] = sampler->order[j];
+        sampler->order[j] = t;
+    }
+}
+sampler_t sampler_make(matrix_t input, matrix_t output, uint64_t batch_size, bool shuffle, uint64_t seed) {
+    /*
+     * input and output hold one sample per row and are not copied, they have to outlive the sampler.
+     * Without shuffle the batches are views of consecutive rows and cost nothing, with it the rows are gathered into a buffer of batch_size rows
+     */
+    assert(input.rows == output.rows);
+    assert(input.rows > 0);
+    assert(batch_size > 0);
+    sampler_t sampler = {0};
+    sampler.input = input;
+    sampler.output = output;
+    sampler.batch_size = batch_size;
+    sampler.shuffle = shuffle;
+    // xorshift has to start from a state that isn't 0
+    sampler.rng = seed != 0 ? seed : 0x9E3779B97F4A7C15ULL;
+    if (shuffle) {
+        sampler.order = (uint64_t*)malloc(sizeof(*sampler.order) * input.rows);
+        assert(sampler.order != NULL);
+        for (uint64_t i = 0; i < input.rows; i++) {
+            sampler.order[i] = i;
+        }
+        sampler_shuffle(&sampler);
+        sampler.gather = batch_malloc(batch_size, input.columns, output.columns);
+    }
+    return sampler;
+}
+void sampler_free(sampler_t sampler) {
+    if (sampler.shuffle) {
+        free(sampler.order);
+        batch_free(sampler.gather);
+    }
+}
+bool sampler_next(sampler_t *sampler, batch *b) {
+    /*
+     * Sets b to the next mini batch of the current epoch, the last one of an epoch can have fewer rows. Returns false instead once the epoch is over,
+     * after which the next call starts a new epoch with a new permutation. A gathered batch is overwritten by the next call
+     */
+    uint64_t total = sampler->input.rows;
+    if (sampler->position >= total) {
+        sampler->position = 0;
+        sampler->epoch++;
+        if (sampler->shuffle) {
+            sampler_shuffle(sampler);
+        }
+        return false;
+    }
+    uint64_t first = sampler->position;
+    uint64_t rows = total - first < sampler->batch_size ? total - first : sampler->batch_size;
+    sampler->position += rows;
+    if (!sampler->shuffle) {
+        b->input = matrix_rows(sampler->input, first, rows);
+        b->output = matrix_rows(sampler->output, first, rows);
+        return true;
+    }
+    // Random rows defeat the hardware prefetcher, so the rows a few copies ahead are requested by hand
+    const uint64_t *order = sampler->order + first;
+    for (uint64_t i = 0; i < rows; i++) {
+        if (i + NN_SAMPLER_PREFETCH < rows) {
+            __builtin_prefetch(&MATRIX_AT(sampler->input, order[i + NN_SAMPLER_PREFETCH], 0));
+            __builtin_prefetch(&MATRIX_AT(sampler->output, order[i + NN_SAMPLER_PREFETCH], 0));
+        }
+        matrix_copy(matrix_row(sampler->gather.input, i), matrix_row(sampler->input, order[i]));
+        matrix_copy(matrix_row(sampler->gather.output, i), matrix_row(sampler->output, order[i]));
+    }
+    b->input = matrix_rows(sampler->gather.input, 0, rows);
+    b->output = matrix_rows(sampler->gather.output, 0, rows);
+    return true;
+}
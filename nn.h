@@ -9,79 +9,221 @@
 #include "math.h"
 #include "stdint.h"
 
+// The element type of every matrix. float is the default for inference and training, since it is what SIMD units are fast at.
+// Build with -DNN_DOUBLE for 64 bit floats or with -DNN_LONG_DOUBLE for the old x87 reference build to check numerics against
+#if defined(NN_LONG_DOUBLE)
+typedef long double nn_scalar_t;
+#define NN_EXP expl
+#define NN_SQRT sqrtl
+#elif defined(NN_DOUBLE)
+typedef double nn_scalar_t;
+#define NN_EXP exp
+#define NN_SQRT sqrt
+#else
+typedef float nn_scalar_t;
+#define NN_EXP expf
+#define NN_SQRT sqrtf
+#endif
+
+// Blocking of matrix_dot. A KC x NR panel of the second matrix is meant to stay in L1, an MC x KC block of the first in L2 and a KC x NC block of the second in L3.
+// NR is one cache line worth of values so that the micro kernel reads exactly one line of the packed second matrix per step of k
+#define NN_GEMM_MR 6
+#define NN_GEMM_NR (64 / sizeof(nn_scalar_t))
+#define NN_GEMM_KC 256
+#define NN_GEMM_MC 128
+#define NN_GEMM_NC 2048
+
+// Rows per forward pass when neuralnet_cost runs a whole data set, enough to make every layer a proper GEMM without huge activation buffers
+#define NN_BATCH_ROWS 256
+
 #define NN_ARRAY_LEN(x) sizeof((x))/sizeof((x)[0])
-#define NN_RAND_DOUBLE(bottom, top) (long double)rand()/RAND_MAX * ((top) - (bottom)) + (bottom)
+#define NN_RAND_DOUBLE(bottom, top) (nn_scalar_t)rand()/RAND_MAX * ((top) - (bottom)) + (bottom)
+
+// Every matrix and every network arena starts on a cache line, and rows of network matrices are padded to a multiple of it so that each row is aligned for SIMD loads
+#define NN_ALIGN 64
+#define NN_ROW_PAD (NN_ALIGN / sizeof(nn_scalar_t))
 
 #ifndef nn_malloc
-#define nn_malloc malloc
+#define nn_malloc(size) aligned_alloc(NN_ALIGN, ((size) / NN_ALIGN + 1) * NN_ALIGN)
 #endif
 
-extern long double nn_relu(long double x);
-extern long double nn_d_relu(long double x);
-extern long double nn_sigmoid(long double x);
-extern long double nn_d_sigmoid(long double x);
+extern nn_scalar_t nn_relu(nn_scalar_t x);
+extern nn_scalar_t nn_d_relu(nn_scalar_t x);
+extern nn_scalar_t nn_sigmoid(nn_scalar_t x);
+extern nn_scalar_t nn_d_sigmoid(nn_scalar_t x);
+
+// Chosen at compile time like nn_scalar_t, so that the vectorized kernels in matrix_activate know which function ACTIVATE is
+#define NN_ACTIVATION_RELU 0
+#define NN_ACTIVATION_SIGMOID 1
+#ifndef NN_ACTIVATION
+#define NN_ACTIVATION NN_ACTIVATION_RELU
+#endif
 
+#if NN_ACTIVATION == NN_ACTIVATION_SIGMOID
+#define ACTIVATE(x) nn_sigmoid((x))
+#define D_ACTIVATE(x) nn_d_sigmoid((x))
+#else
 #define ACTIVATE(x) nn_relu((x))
 #define D_ACTIVATE(x) nn_d_relu((x))
+#endif
 
 typedef struct {
     uint64_t rows;
     uint64_t columns;
     uint64_t stride;
-    long double *values;
+    nn_scalar_t *values;
 } matrix_t;
 
 #define MATRIX_AT(m, i, j) (m).values[(i) * (m).stride + (j)]
 
 typedef struct {
     uint64_t count; // amount of weights and biases
-    matrix_t *weights;
+    matrix_t *weights; // weights, biases and activations are one allocation of 3 * count + 1 matrices, freed through weights
     matrix_t *biases;
     matrix_t *activations;
+    // All weights and biases back to back, then all activations, in one aligned block. A batch only has activations in its arena and uses the parameters of its net
+    nn_scalar_t *arena;
+    uint64_t arena_size; // in values, not bytes
+    // Start of the weights and biases, the arena for a net of its own, the parameters of the parent for a batch and the file mapping for a loaded net
+    nn_scalar_t *parameters;
+    uint64_t parameter_size;
+    // Only set for nets from neuralnet_load, the parameters are then read only and unmapped by neuralnet_free
+    void *mapping;
+    uint64_t mapping_size; // in bytes
 } neuralnet_t;
 
+// Model files, see neuralnet_save. Everything is in native byte order and the scalar size has to match the build that loads it
+#define NN_MODEL_MAGIC "BLADENN"
+#define NN_MODEL_VERSION 1
+
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t scalar_size;
+    uint64_t count; // amount of layers, the architecture has count + 1 entries
+    uint64_t parameter_offset; // in bytes from the start of the file, always a multiple of NN_ALIGN
+    uint64_t parameter_size; // in values
+} nn_model_header_t;
+
 #define NN_INPUT(n) (n).activations[0]
 #define NN_OUTPUT(n) (n).activations[(n).count]
 
+// Active features of one sample of a one hot input layer, every listed feature is 1 and all others are 0. See neuralnet_forward_sparse
+#define NN_SPARSE_MAX 32
+
+typedef struct {
+    uint64_t count;
+    uint16_t features[NN_SPARSE_MAX];
+} nn_sparse_t;
+
+// First layer pre activations of a net with a one hot input, kept up to date by adding and subtracting the weight rows of the features that change.
+// One row per ply so that undoing a move is just going back a row
+typedef struct {
+    neuralnet_t net; // Shares the weights of the net, one row of activations for the layers above the accumulator
+    matrix_t stack;
+    uint64_t ply;
+} accumulator_t;
+
+// One mini batch, a sample per row in the layout neuralnet_backprop and neuralnet_predict take
 typedef struct {
     matrix_t input;
     matrix_t output;
 } batch;
 
+// Hands out the rows of a data set as mini batches, every row exactly once per epoch. See sampler_next
+typedef struct {
+    matrix_t input;
+    matrix_t output;
+    uint64_t batch_size;
+    bool shuffle;
+    uint64_t *order; // Permutation of the rows for the current epoch
+    uint64_t position; // Into order, where the next batch starts
+    uint64_t epoch;
+    uint64_t rng;
+    batch gather; // batch_size rows the shuffled samples are copied into
+} sampler_t;
+
+// Rows ahead of the one being copied that sampler_next prefetches
+#define NN_SAMPLER_PREFETCH 4
+
 ///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 /// ---MATRIX---
 ///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
 extern matrix_t matrix_malloc(uint64_t rows, uint64_t columns);
+extern void matrix_gemm(matrix_t destination, matrix_t first, bool first_transposed, matrix_t second, bool second_transposed, bool accumulate);
 extern void matrix_dot(matrix_t destination, matrix_t first, matrix_t second);
+extern void matrix_dot_tn(matrix_t destination, matrix_t first, matrix_t second);
+extern void matrix_dot_nt(matrix_t destination, matrix_t first, matrix_t second);
+extern void matrix_dot_tt(matrix_t destination, matrix_t first, matrix_t second);
 extern matrix_t matrix_row(matrix_t first, uint64_t row);
+extern matrix_t matrix_rows(matrix_t first, uint64_t row, uint64_t rows);
+extern matrix_t matrix_columns(matrix_t first, uint64_t column, uint64_t columns);
 extern void matrix_copy(matrix_t destination, matrix_t first);
 extern void matrix_sum(matrix_t destination, matrix_t first);
+extern void matrix_sum_broadcast(matrix_t destination, matrix_t first);
+extern void matrix_sum_rows(matrix_t destination, matrix_t first);
+extern void matrix_transpose(matrix_t destination, matrix_t first);
+extern void matrix_axpy(matrix_t destination, nn_scalar_t alpha, matrix_t first);
+extern void matrix_scale(matrix_t destination, nn_scalar_t alpha);
 extern void matrix_activate(matrix_t destination);
+extern void matrix_d_activate(matrix_t destination, matrix_t first);
 extern void matrix_print(matrix_t destination, const char *name, uint64_t padding);
-extern void matrix_fill(matrix_t destination, long double filler);
-extern void matrix_random(matrix_t destination, long double bottom, long double top);
+extern void matrix_fill(matrix_t destination, nn_scalar_t filler);
+extern void matrix_random(matrix_t destination, nn_scalar_t bottom, nn_scalar_t top);
 
 ///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 /// ---NEURALNET---
 ///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
 extern neuralnet_t neuralnet_malloc(uint64_t *architecture, uint64_t architecture_count);
-extern void neuralnet_fill(neuralnet_t net, long double fill);
+extern neuralnet_t neuralnet_malloc_like(neuralnet_t net);
+extern void neuralnet_free(neuralnet_t net);
+extern neuralnet_t neuralnet_clone(neuralnet_t net);
+extern void neuralnet_copy(neuralnet_t destination, neuralnet_t source);
+extern neuralnet_t neuralnet_share(neuralnet_t net);
+extern neuralnet_t neuralnet_batch(neuralnet_t net, uint64_t rows);
+extern void neuralnet_batch_free(neuralnet_t batch);
+extern void neuralnet_fill(neuralnet_t net, nn_scalar_t fill);
 extern void neuralnet_random(neuralnet_t net, float bottom, float top);
 extern void neuralnet_nudge(neuralnet_t net, neuralnet_t nudge);
+extern void neuralnet_perturb(neuralnet_t destination, neuralnet_t source, uint64_t seed, nn_scalar_t scale);
 extern void neuralnet_forward(neuralnet_t net);
-extern long double neuralnet_cost(neuralnet_t net, matrix_t input, matrix_t output);
+extern void neuralnet_forward_rows(neuralnet_t net, uint64_t rows);
+extern void neuralnet_predict(neuralnet_t net, matrix_t input, matrix_t output);
+extern nn_scalar_t neuralnet_cost(neuralnet_t net, matrix_t input, matrix_t output);
 extern void neuralnet_backprop(neuralnet_t net, neuralnet_t gradient, matrix_t input, matrix_t output);
-extern void neuralnet_learn(neuralnet_t net, neuralnet_t gradient, long double rate);
+extern void neuralnet_backprop_batch(neuralnet_t net, neuralnet_t gradient, neuralnet_t forward, neuralnet_t backward, matrix_t input, matrix_t output);
+extern void neuralnet_learn(neuralnet_t net, neuralnet_t gradient, nn_scalar_t rate);
+extern void neuralnet_forward_sparse(neuralnet_t net, const nn_sparse_t *input, uint64_t rows);
+extern void neuralnet_forward_hidden(neuralnet_t net, uint64_t rows);
+extern void neuralnet_backprop_sparse(neuralnet_t net, neuralnet_t gradient, const nn_sparse_t *input, matrix_t output);
+extern void neuralnet_learn_sparse(neuralnet_t net, neuralnet_t gradient, const nn_sparse_t *input, uint64_t rows, nn_scalar_t rate);
 extern void neuralnet_print(neuralnet_t net, const char *name);
+extern bool neuralnet_save(neuralnet_t net, const char *path);
+extern bool neuralnet_load(neuralnet_t *net, const char *path);
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// ---ACCUMULATOR---
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+extern accumulator_t *accumulator_alloc(neuralnet_t net, uint64_t plies);
+extern void accumulator_free(accumulator_t *accumulator);
+extern void accumulator_refresh(accumulator_t *accumulator, const nn_sparse_t *input);
+extern void accumulator_push(accumulator_t *accumulator, const uint16_t *added, uint64_t added_count, const uint16_t *removed, uint64_t removed_count);
+extern void accumulator_pop(accumulator_t *accumulator);
+extern void accumulator_store(accumulator_t *accumulator, neuralnet_t net, uint64_t row);
+extern matrix_t accumulator_forward(accumulator_t *accumulator);
 
 ///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 /// ---BATCHES---
 ///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
-extern batch batch_malloc(uint64_t batch_size, uint64_t input_size, uint64_t output_size);
-extern void batch_make(batch batch, uint64_t batch_size, uint64_t input_size, uint64_t output_size, matrix_t input, matrix_t output);
+extern batch batch_malloc(uint64_t rows, uint64_t input_columns, uint64_t output_columns);
+extern void batch_free(batch b);
 extern void batch_print(batch b, const char *name);
+extern sampler_t sampler_make(matrix_t input, matrix_t output, uint64_t batch_size, bool shuffle, uint64_t seed);
+extern void sampler_free(sampler_t sampler);
+extern bool sampler_next(sampler_t *sampler, batch *b);
 
 #endif
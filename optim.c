@@ -0,0 +1,63 @@
+#include "optim.h"
+#include "kernels.h"
+#include "nn.h"
+#include <assert.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+optim_t *optim_alloc(neuralnet_t net, enum optim_kind kind, nn_scalar_t rate) {
+    /*
+     * The state starts at zero, change beta1, beta2 and epsilon in the returned optim_t before the first step to use something other than the defaults
+     */
+    optim_t *optim = calloc(1, sizeof(*optim));
+    assert(optim != NULL);
+    optim->kind = kind;
+    optim->rate = rate;
+    optim->beta1 = OPTIM_BETA1;
+    optim->beta2 = OPTIM_BETA2;
+    optim->epsilon = OPTIM_EPSILON;
+    if(kind == optim_momentum || kind == optim_adam) {
+        optim->first = neuralnet_malloc_like(net);
+        neuralnet_fill(optim->first, 0);
+    }
+    if(kind == optim_adam) {
+        optim->second = neuralnet_malloc_like(net);
+        neuralnet_fill(optim->second, 0);
+    }
+    return(optim);
+}
+void optim_free(optim_t *optim) {
+    if(optim->first.count > 0) {
+        neuralnet_free(optim->first);
+    }
+    if(optim->second.count > 0) {
+        neuralnet_free(optim->second);
+    }
+    free(optim);
+}
+void optim_step(optim_t *optim, neuralnet_t net, neuralnet_t gradient) {
+    /*
+     * net, gradient and the state all have the same architecture and therefore the same arena layout, padding included.
+     * That makes the update one kernel call over the whole parameter block instead of one per matrix row, and each value is read and written exactly once.
+     * The padding is zero in all of them and stays zero, for Adam 0 / (sqrt(0) + epsilon) is still 0
+     */
+    assert(net.parameter_size == gradient.parameter_size);
+    assert(net.mapping == NULL);
+    optim->steps++;
+    switch(optim->kind) {
+        case optim_sgd:
+            kernels.axpy(net.parameters, -optim->rate, gradient.parameters, net.parameter_size);
+            break;
+        case optim_momentum:
+            kernels.momentum(net.parameters, gradient.parameters, optim->first.parameters, net.parameter_size, optim->rate, optim->beta1);
+            break;
+        case optim_adam: {
+            // The bias correction of both moments as one factor on the rate, so the kernel does not need the step count
+            nn_scalar_t correction = sqrt(1 - pow(optim->beta2, optim->steps)) / (1 - pow(optim->beta1, optim->steps));
+            kernels.adam(net.parameters, gradient.parameters, optim->first.parameters, optim->second.parameters, net.parameter_size,
+                         optim->rate * correction, optim->beta1, optim->beta2, optim->epsilon);
+            break;
+        }
+    }
+}
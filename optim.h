@@ -0,0 +1,33 @@
+#ifndef OPTIM_H
+#define OPTIM_H
+
+#include "nn.h"
+#include <stdint.h>
+
+// Defaults of optim_alloc, the usual ones from the Adam paper. The momentum optimizer uses beta1 as its momentum
+#define OPTIM_BETA1 0.9
+#define OPTIM_BETA2 0.999
+#define OPTIM_EPSILON 1e-8
+
+enum optim_kind {
+    optim_sgd = 0, optim_momentum = 1, optim_adam = 2
+};
+
+typedef struct {
+    enum optim_kind kind;
+    nn_scalar_t rate;
+    nn_scalar_t beta1;
+    nn_scalar_t beta2;
+    nn_scalar_t epsilon;
+    int64_t steps;
+    // Velocity for momentum, first and second moments for Adam. Nets of the same architecture as the one being trained, so that the state of every parameter
+    // sits at the same offset in its arena as the parameter and the gradient. Unused ones have a count of 0
+    neuralnet_t first;
+    neuralnet_t second;
+} optim_t;
+
+extern optim_t *optim_alloc(neuralnet_t net, enum optim_kind kind, nn_scalar_t rate);
+extern void optim_free(optim_t *optim);
+extern void optim_step(optim_t *optim, neuralnet_t net, neuralnet_t gradient);
+
+#endif
@@ -0,0 +1,201 @@
+#include "quant.h"
+#include "kernels.h"
+#include "loader.h"
+#include "nn.h"
+#include <assert.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static void quant_layer_init(quant_layer_t *layer, matrix_t weights, matrix_t biases, nn_scalar_t input_max) {
+    /*
+     * One scale for all weights of the layer and one for its inputs, both map the largest magnitude seen to QUANT_MAX
+     */
+    nn_scalar_t weight_max = 0;
+    for(uint64_t i = 0; i < weights.rows; i++) {
+        for(uint64_t j = 0; j < weights.columns; j++) {
+            nn_scalar_t x = MATRIX_AT(weights, i, j) < 0 ? -MATRIX_AT(weights, i, j) : MATRIX_AT(weights, i, j);
+            weight_max = x > weight_max ? x : weight_max;
+        }
+    }
+    nn_scalar_t weight_scale = weight_max > 0 ? QUANT_MAX / weight_max : 1;
+    layer->quantized = true;
+    layer->input_scale = input_max > 0 ? QUANT_MAX / input_max : 1;
+    layer->output_scale = 1 / (layer->input_scale * weight_scale);
+    layer->depth = (weights.rows + QUANT_PAD - 1) / QUANT_PAD * QUANT_PAD;
+    layer->weights = calloc(weights.columns * layer->depth, sizeof(*layer->weights));
+    layer->biases = malloc(sizeof(*layer->biases) * weights.columns);
+    assert(layer->weights != NULL);
+    assert(layer->biases != NULL);
+    for(uint64_t j = 0; j < weights.columns; j++) {
+        for(uint64_t i = 0; i < weights.rows; i++) {
+            layer->weights[j * layer->depth + i] = (int8_t) lrint(MATRIX_AT(weights, i, j) * weight_scale);
+        }
+        layer->biases[j] = (int32_t) lrint(MATRIX_AT(biases, 0, j) / layer->output_scale);
+    }
+}
+quant_t *quant_alloc(neuralnet_t net, matrix_t calibration) {
+    /*
+     * Post training quantization of net. calibration is a set of typical inputs, one per row, the float net is run on them to find the range of every layers input.
+     * Every layer but the last one runs in int8 if its inputs are never negative, which after the first layer they never are. The output layer always stays
+     * float since its few multiplies are not worth the precision, and so does a first layer with signed inputs like the raw squares of a board
+     */
+    assert(calibration.columns == NN_INPUT(net).columns);
+    assert(calibration.rows > 0);
+    quant_t *quant = calloc(1, sizeof(*quant));
+    assert(quant != NULL);
+    quant->net = neuralnet_batch(net, 1);
+    quant->layers = calloc(net.count, sizeof(*quant->layers));
+    assert(quant->layers != NULL);
+
+    nn_scalar_t *maximum = calloc(net.count + 1, sizeof(*maximum));
+    bool *negative = calloc(net.count + 1, sizeof(*negative));
+    assert(maximum != NULL);
+    assert(negative != NULL);
+    neuralnet_t batch = neuralnet_batch(net, calibration.rows < NN_BATCH_ROWS ? calibration.rows : NN_BATCH_ROWS);
+    for(uint64_t i = 0; i < calibration.rows; i += NN_INPUT(batch).rows) {
+        uint64_t rows = calibration.rows - i < NN_INPUT(batch).rows ? calibration.rows - i : NN_INPUT(batch).rows;
+        matrix_copy(matrix_rows(NN_INPUT(batch), 0, rows), matrix_rows(calibration, i, rows));
+        neuralnet_forward_rows(batch, rows);
+        for(uint64_t l = 0; l <= net.count; l++) {
+            for(uint64_t r = 0; r < rows; r++) {
+                for(uint64_t j = 0; j < batch.activations[l].columns; j++) {
+                    nn_scalar_t x = MATRIX_AT(batch.activations[l], r, j);
+                    maximum[l] = x > maximum[l] ? x : maximum[l];
+                    negative[l] = negative[l] || x < 0;
+                }
+            }
+        }
+    }
+    neuralnet_batch_free(batch);
+
+    uint64_t widest = 1;
+    uint64_t widest_output = 1;
+    for(uint64_t l = 0; l + 1 < net.count; l++) {
+        if(!negative[l]) {
+            quant_layer_init(&quant->layers[l], net.weights[l], net.biases[l], maximum[l]);
+            widest = quant->layers[l].depth > widest ? quant->layers[l].depth : widest;
+            widest_output = net.weights[l].columns > widest_output ? net.weights[l].columns : widest_output;
+        }
+    }
+    quant->input = calloc(widest, sizeof(*quant->input));
+    quant->sums = calloc(widest_output, sizeof(*quant->sums));
+    assert(quant->input != NULL);
+    assert(quant->sums != NULL);
+    free(maximum);
+    free(negative);
+    return(quant);
+}
+void quant_free(quant_t *quant) {
+    for(uint64_t l = 0; l < quant->net.count; l++) {
+        free(quant->layers[l].weights);
+        free(quant->layers[l].biases);
+    }
+    free(quant->layers);
+    free(quant->input);
+    free(quant->sums);
+    neuralnet_batch_free(quant->net);
+    free(quant);
+}
+void quant_forward(quant_t *quant) {
+    /*
+     * neuralnet_forward for one position. A quantized layer turns its input row into bytes, takes one int8 dot product per output and scales the int32 sum back
+     * to float, so the activations between layers stay floats and every layer can pick its precision on its own
+     */
+    neuralnet_t net = quant->net;
+    for(uint64_t l = 0; l < net.count; l++) {
+        matrix_t output = net.activations[l + 1];
+        quant_layer_t *layer = &quant->layers[l];
+        if(!layer->quantized) {
+            matrix_dot(output, net.activations[l], net.weights[l]);
+            matrix_sum_broadcast(output, net.biases[l]);
+        } else {
+            matrix_t input = net.activations[l];
+            for(uint64_t i = 0; i < input.columns; i++) {
+                // Clamped before rounding by truncation instead of calling lrint, so that this loop vectorizes
+                nn_scalar_t q = MATRIX_AT(input, 0, i) * layer->input_scale;
+                q = q < 0 ? 0 : (q > QUANT_MAX ? QUANT_MAX : q);
+                quant->input[i] = (uint8_t) (q + (nn_scalar_t) 0.5);
+            }
+            memset(quant->input + input.columns, 0, layer->depth - input.columns);
+            kernels.dot_i8(quant->sums, quant->input, layer->weights, layer->depth, output.columns);
+            for(uint64_t j = 0; j < output.columns; j++) {
+                MATRIX_AT(output, 0, j) = (quant->sums[j] + layer->biases[j]) * layer->output_scale;
+            }
+        }
+        matrix_activate(output);
+    }
+}
+void quant_report(quant_t *quant, neuralnet_t net, matrix_t input, matrix_t output, double sums[3]) {
+    /*
+     * Adds the squared error of the float net, the squared error of the quantized one and the squared difference between both over the rows of input to sums,
+     * so that a data set can be reported on in pieces
+     */
+    assert(input.rows == output.rows);
+    neuralnet_t batch = neuralnet_batch(net, input.rows < NN_BATCH_ROWS ? input.rows : NN_BATCH_ROWS);
+    for(uint64_t i = 0; i < input.rows; i += NN_INPUT(batch).rows) {
+        uint64_t rows = input.rows - i < NN_INPUT(batch).rows ? input.rows - i : NN_INPUT(batch).rows;
+        matrix_copy(matrix_rows(NN_INPUT(batch), 0, rows), matrix_rows(input, i, rows));
+        neuralnet_forward_rows(batch, rows);
+        for(uint64_t r = 0; r < rows; r++) {
+            matrix_copy(NN_INPUT(quant->net), matrix_row(input, i + r));
+            quant_forward(quant);
+            for(uint64_t j = 0; j < output.columns; j++) {
+                double expected = MATRIX_AT(output, i + r, j);
+                double exact = MATRIX_AT(NN_OUTPUT(batch), r, j);
+                double quantized = MATRIX_AT(NN_OUTPUT(quant->net), 0, j);
+                sums[0] += (exact - expected) * (exact - expected);
+                sums[1] += (quantized - expected) * (quantized - expected);
+                sums[2] += (quantized - exact) * (quantized - exact);
+            }
+        }
+    }
+    neuralnet_batch_free(batch);
+}
+bool quant_calibrate_file(const char *model_path, const char *data_path) {
+    /*
+     * The calibration tool: loads a model saved by neuralnet_save, calibrates on the first QUANT_CALIBRATION_ROWS samples of a data file in the format of
+     * loader_file_append and reports the cost of the float and the quantized net over the whole file
+     */
+    neuralnet_t net;
+    if(!neuralnet_load(&net, model_path)) {
+        return(false);
+    }
+    loader_file_t *file = loader_file_open(data_path, NN_INPUT(net).columns, NN_OUTPUT(net).columns);
+    if(file == NULL) {
+        neuralnet_free(net);
+        return(false);
+    }
+    loader_t *loader = loader_alloc(QUANT_CALIBRATION_ROWS, NN_INPUT(net).columns, NN_OUTPUT(net).columns, 2, loader_file_fill, file);
+    quant_t *quant = NULL;
+    double sums[3] = {0, 0, 0};
+    int64_t samples = 0;
+    batch b;
+    while(loader_next(loader, &b)) {
+        if(quant == NULL) {
+            quant = quant_alloc(net, b.input);
+        }
+        quant_report(quant, net, b.input, b.output, sums);
+        samples += b.input.rows;
+    }
+    loader_free(loader);
+    loader_file_close(file);
+    if(quant == NULL) {
+        fprintf(stderr, "ERROR: %s has no samples\n", data_path);
+        neuralnet_free(net);
+        return(false);
+    }
+    for(uint64_t l = 0; l < net.count; l++) {
+        printf("INFO: layer %lu %lux%lu %s\n", l, net.weights[l].rows, net.weights[l].columns, quant->layers[l].quantized ? "int8" : "float");
+    }
+    printf("INFO: samples %ld\n", samples);
+    printf("INFO: float cost %.6f\n", sums[0] / samples);
+    printf("INFO: int8 cost  %.6f\n", sums[1] / samples);
+    printf("INFO: mean squared difference %.6g\n", sums[2] / samples);
+    quant_free(quant);
+    neuralnet_free(net);
+    return(true);
+}
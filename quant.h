@@ -0,0 +1,34 @@
+#ifndef QUANT_H
+#define QUANT_H
+
+#include "nn.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+#define QUANT_MAX 127 // Activations and weights are quantized to [0, 127] and [-127, 127], which keeps the 16 bit pair sums of kernels.dot_i8 from saturating
+#define QUANT_PAD 32 // Inputs of a quantized layer are padded with zeros to a whole AVX2 register of bytes
+#define QUANT_CALIBRATION_ROWS 4096 // Samples quant_calibrate_file picks the activation ranges from
+
+typedef struct {
+    bool quantized;
+    uint64_t depth; // Inputs, padded to QUANT_PAD
+    int8_t *weights; // The transposed weights, one row of depth per output so that every output is one contiguous dot product
+    int32_t *biases;
+    nn_scalar_t input_scale; // An input x is stored as x * input_scale, rounded and clamped to [0, QUANT_MAX]
+    nn_scalar_t output_scale; // 1 / (input_scale * weight scale), turns the int32 sums back into floats
+} quant_layer_t;
+
+typedef struct {
+    neuralnet_t net; // Shares the float weights of the net it was made for, fill NN_INPUT(quant->net) and read NN_OUTPUT(quant->net)
+    quant_layer_t *layers;
+    uint8_t *input; // The quantized input of the current layer
+    int32_t *sums; // Its int32 outputs, as long as the widest layer
+} quant_t;
+
+extern quant_t *quant_alloc(neuralnet_t net, matrix_t calibration);
+extern void quant_free(quant_t *quant);
+extern void quant_forward(quant_t *quant);
+extern void quant_report(quant_t *quant, neuralnet_t net, matrix_t input, matrix_t output, double sums[3]);
+extern bool quant_calibrate_file(const char *model_path, const char *data_path);
+
+#endif
@@ -0,0 +1,141 @@
+#define _GNU_SOURCE
+#include "team.h"
+#include "nn.h"
+#include <assert.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+static void team_barrier_wait(team_barrier_t *barrier) {
+    /*
+     * The last thread to arrive resets the count and then bumps the generation, everybody else spins until the generation changes.
+     * No syscalls on the fast path, which is the point of this over pthread barriers when a whole layer only takes microseconds
+     */
+    int64_t generation = atomic_load(&barrier->generation);
+    if(atomic_fetch_add(&barrier->count, 1) == barrier->threads - 1) {
+        atomic_store(&barrier->count, 0);
+        atomic_fetch_add(&barrier->generation, 1);
+        return;
+    }
+    for(int64_t spins = 0; atomic_load(&barrier->generation) == generation; spins++) {
+        if(spins < TEAM_SPIN) {
+#if defined(__x86_64__) || defined(__i386__)
+            __builtin_ia32_pause();
+#endif
+        } else {
+            sched_yield();
+        }
+    }
+}
+static void team_work(team_worker_t *worker) {
+    /*
+     * Every layer is split by output columns, each thread computes its slice of the row from the whole previous row and its columns of the weights.
+     * The barrier after each layer makes the full row visible before anyone reads it as the next input
+     */
+    team_t *team = worker->team;
+    neuralnet_t net = team->net;
+    for(uint64_t i = 0; i < net.count; i++) {
+        uint64_t columns = net.weights[i].columns;
+        uint64_t share = (columns + team->thread_count - 1) / team->thread_count;
+        share = (share + TEAM_COLUMN_ALIGN - 1) / TEAM_COLUMN_ALIGN * TEAM_COLUMN_ALIGN;
+        uint64_t first = share * worker->index < columns ? share * worker->index : columns;
+        uint64_t count = columns - first < share ? columns - first : share;
+        if(count > 0) {
+            matrix_t output = matrix_columns(net.activations[i+1], first, count);
+            matrix_dot(output, net.activations[i], matrix_columns(net.weights[i], first, count));
+            matrix_sum_broadcast(output, matrix_columns(net.biases[i], first, count));
+            matrix_activate(output);
+        }
+        team_barrier_wait(&team->barrier);
+    }
+}
+static void *team_thread(void *argument) {
+    team_worker_t *worker = argument;
+    team_t *team = worker->team;
+    while(true) {
+        // Parked here between forward passes
+        team_barrier_wait(&team->barrier);
+        if(atomic_load(&team->quit)) {
+            break;
+        }
+        team_work(worker);
+    }
+    return(NULL);
+}
+team_t *team_alloc(neuralnet_t net, int64_t thread_count, bool pin) {
+    /*
+     * For the latency of a single forward pass, not throughput, see neuralnet_batch for that. Worker 0 is the thread that calls team_forward.
+     * With pin the calling thread is bound to the core it is running on and every helper to its own core counting up from the next one.
+     * team_free gives the caller its old affinity back, so team_forward should be called from the same thread as team_alloc
+     */
+    assert(thread_count > 0 && thread_count <= TEAM_THREADS_MAX);
+    assert(NN_INPUT(net).rows == 1);
+    team_t *team = calloc(1, sizeof(*team));
+    assert(team != NULL);
+    team->net = neuralnet_share(net);
+    team->thread_count = thread_count;
+    team->barrier.threads = thread_count;
+    atomic_init(&team->barrier.count, 0);
+    atomic_init(&team->barrier.generation, 0);
+    atomic_init(&team->quit, false);
+    int64_t cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    int64_t cpu = sched_getcpu();
+    pin = pin && cpus > 0 && cpu >= 0;
+    if(pin) {
+        // Otherwise the scheduler is free to move worker 0 onto the core of a helper, which then has to wait for it at every barrier
+        cpu_set_t *affinity = malloc(sizeof(*affinity));
+        assert(affinity != NULL);
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(cpu, &set);
+        // Failing to pin only costs some latency, so this is not an error
+        if(pthread_getaffinity_np(pthread_self(), sizeof(*affinity), affinity) == 0 && pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0) {
+            team->affinity = affinity;
+        } else {
+            free(affinity);
+        }
+    }
+    for(int64_t i = 0; i < thread_count; i++) {
+        team->workers[i].team = team;
+        team->workers[i].index = i;
+    }
+    for(int64_t i = 1; i < thread_count; i++) {
+        if(pthread_create(&team->threads[i], NULL, team_thread, &team->workers[i]) != 0) {
+            fprintf(stderr, "ERROR: Could not start team worker %ld\n", i);
+            exit(1);
+        }
+        if(pin) {
+            cpu_set_t set;
+            CPU_ZERO(&set);
+            CPU_SET((cpu + i) % cpus, &set);
+            pthread_setaffinity_np(team->threads[i], sizeof(set), &set);
+        }
+    }
+    return(team);
+}
+void team_free(team_t *team) {
+    atomic_store(&team->quit, true);
+    if(team->thread_count > 1) {
+        team_barrier_wait(&team->barrier);
+    }
+    for(int64_t i = 1; i < team->thread_count; i++) {
+        pthread_join(team->threads[i], NULL);
+    }
+    if(team->affinity != NULL) {
+        pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), team->affinity);
+        free(team->affinity);
+    }
+    neuralnet_batch_free(team->net);
+    free(team);
+}
+void team_forward(team_t *team) {
+    if(team->thread_count > 1) {
+        team_barrier_wait(&team->barrier);
+    }
+    team_work(&team->workers[0]);
+}
@@ -0,0 +1,41 @@
+#ifndef TEAM_H
+#define TEAM_H
+
+#include "nn.h"
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#define TEAM_THREADS_MAX 64
+#define TEAM_SPIN 4096 // Busy waits before a waiting thread starts yielding its core, a forward pass is over long before that on a dedicated core
+#define TEAM_COLUMN_ALIGN 16 // Every thread gets a multiple of a cache line of output columns so that no two threads write to the same line
+
+typedef struct {
+    atomic_int_fast64_t count;
+    atomic_int_fast64_t generation;
+    int64_t threads;
+} team_barrier_t;
+
+struct team;
+
+typedef struct {
+    struct team *team;
+    int64_t index;
+} team_worker_t;
+
+typedef struct team {
+    neuralnet_t net; // Shares the weights of the net the team was made for, fill NN_INPUT(team->net) and read NN_OUTPUT(team->net)
+    int64_t thread_count;
+    team_worker_t workers[TEAM_THREADS_MAX];
+    pthread_t threads[TEAM_THREADS_MAX];
+    team_barrier_t barrier;
+    atomic_bool quit;
+    void *affinity; // cpu_set_t of the calling thread from before team_alloc pinned it, NULL if it wasn't
+} team_t;
+
+extern team_t *team_alloc(neuralnet_t net, int64_t thread_count, bool pin);
+extern void team_free(team_t *team);
+extern void team_forward(team_t *team);
+
+#endif
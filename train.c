@@ -0,0 +1,120 @@
+#include "train.h"
+#include "nn.h"
+#include <assert.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+static void train_work(train_worker_t *worker) {
+    /*
+     * Every worker backprops a contiguous slice of the rows and weights its gradient by the size of that slice, so that a plain sum of all of them is the gradient of the whole batch.
+     * The sum is a tree: in round s every worker whose index is a multiple of 2s adds the gradient of worker index + s into its own.
+     * Each addition streams through two gradients once and the pairs of one round touch disjoint memory, so the reduction scales with the threads instead of serialising on worker 0
+     */
+    train_t *train = worker->train;
+    uint64_t rows = train->input.rows;
+    uint64_t share = (rows + train->thread_count - 1) / train->thread_count;
+    uint64_t first = share * worker->index < rows ? share * worker->index : rows;
+    uint64_t count = rows - first < share ? rows - first : share;
+    if(count > 0) {
+        neuralnet_backprop_batch(train->net, worker->gradient, worker->forward, worker->backward, matrix_rows(train->input, first, count), matrix_rows(train->output, first, count));
+        if(count != rows) {
+            for(uint64_t i = 0; i < worker->gradient.count; i++) {
+                matrix_scale(worker->gradient.weights[i], (nn_scalar_t) count / rows);
+                matrix_scale(worker->gradient.biases[i], (nn_scalar_t) count / rows);
+            }
+        }
+    } else {
+        neuralnet_fill(worker->gradient, 0);
+    }
+    for(int64_t stride = 1; stride < train->thread_count; stride *= 2) {
+        pthread_barrier_wait(&train->barrier);
+        if(worker->index % (2 * stride) == 0 && worker->index + stride < train->thread_count) {
+            neuralnet_t other = train->workers[worker->index + stride].gradient;
+            for(uint64_t i = 0; i < worker->gradient.count; i++) {
+                matrix_sum(worker->gradient.weights[i], other.weights[i]);
+                matrix_sum(worker->gradient.biases[i], other.biases[i]);
+            }
+        }
+    }
+}
+static void *train_thread(void *argument) {
+    train_worker_t *worker = argument;
+    train_t *train = worker->train;
+    while(true) {
+        // Parked here between steps, train_gradient releases everybody at once by arriving as the last thread
+        pthread_barrier_wait(&train->barrier);
+        if(train->quit) {
+            break;
+        }
+        train_work(worker);
+        pthread_barrier_wait(&train->barrier);
+    }
+    return(NULL);
+}
+train_t *train_alloc(neuralnet_t net, int64_t thread_count) {
+    /*
+     * Worker 0 runs on the thread that calls train_gradient, the others are started once here and kept until train_free
+     */
+    assert(thread_count > 0 && thread_count <= TRAIN_THREADS_MAX);
+    train_t *train = calloc(1, sizeof(*train));
+    assert(train != NULL);
+    train->net = net;
+    train->thread_count = thread_count;
+    if(pthread_barrier_init(&train->barrier, NULL, thread_count) != 0) {
+        fprintf(stderr, "ERROR: Could not create the training barrier\n");
+        exit(1);
+    }
+    for(int64_t i = 0; i < thread_count; i++) {
+        train->workers[i].train = train;
+        train->workers[i].index = i;
+        train->workers[i].gradient = neuralnet_malloc_like(net);
+        train->workers[i].forward = neuralnet_batch(net, NN_BATCH_ROWS);
+        train->workers[i].backward = neuralnet_batch(train->workers[i].gradient, NN_BATCH_ROWS);
+    }
+    for(int64_t i = 1; i < thread_count; i++) {
+        if(pthread_create(&train->threads[i], NULL, train_thread, &train->workers[i]) != 0) {
+            fprintf(stderr, "ERROR: Could not start training worker %ld\n", i);
+            exit(1);
+        }
+    }
+    return(train);
+}
+void train_free(train_t *train) {
+    train->quit = true;
+    if(train->thread_count > 1) {
+        pthread_barrier_wait(&train->barrier);
+    }
+    for(int64_t i = 1; i < train->thread_count; i++) {
+        pthread_join(train->threads[i], NULL);
+    }
+    for(int64_t i = 0; i < train->thread_count; i++) {
+        neuralnet_batch_free(train->workers[i].forward);
+        neuralnet_batch_free(train->workers[i].backward);
+        neuralnet_free(train->workers[i].gradient);
+    }
+    pthread_barrier_destroy(&train->barrier);
+    free(train);
+}
+neuralnet_t train_gradient(train_t *train, matrix_t input, matrix_t output) {
+    /*
+     * Same result as neuralnet_backprop over the whole batch, up to rounding. The returned gradient belongs to train and is overwritten by the next step
+     */
+    assert(input.rows == output.rows);
+    assert(input.rows > 0);
+    train->input = input;
+    train->output = output;
+    if(train->thread_count > 1) {
+        pthread_barrier_wait(&train->barrier);
+    }
+    train_work(&train->workers[0]);
+    if(train->thread_count > 1) {
+        pthread_barrier_wait(&train->barrier);
+    }
+    return(train->workers[0].gradient);
+}
+void train_step(train_t *train, matrix_t input, matrix_t output, nn_scalar_t rate) {
+    neuralnet_learn(train->net, train_gradient(train, input, output), rate);
+}
@@ -0,0 +1,39 @@
+#ifndef TRAIN_H
+#define TRAIN_H
+
+#include "nn.h"
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#define TRAIN_THREADS_MAX 64
+
+struct train;
+
+typedef struct {
+    struct train *train;
+    int64_t index;
+    neuralnet_t gradient; // Gradient over this workers share of the batch, after a step workers[0] holds the one for the whole batch
+    // Activations and their gradients for neuralnet_backprop_batch, allocated once so that a step allocates nothing
+    neuralnet_t forward;
+    neuralnet_t backward;
+} train_worker_t;
+
+typedef struct train {
+    neuralnet_t net;
+    int64_t thread_count;
+    train_worker_t workers[TRAIN_THREADS_MAX];
+    pthread_t threads[TRAIN_THREADS_MAX];
+    pthread_barrier_t barrier;
+    // The batch of the current step, only valid while one is running
+    matrix_t input;
+    matrix_t output;
+    bool quit;
+} train_t;
+
+extern train_t *train_alloc(neuralnet_t net, int64_t thread_count);
+extern void train_free(train_t *train);
+extern neuralnet_t train_gradient(train_t *train, matrix_t input, matrix_t output);
+extern void train_step(train_t *train, matrix_t input, matrix_t output, nn_scalar_t rate);
+
+#endif
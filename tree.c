@@ -0,0 +1,320 @@
+#include "tree.h"
+#include "chess.h"
+#include <assert.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct {
+    tree_t *tree;
+    int64_t index;
+    int64_t depth;
+    tree_node_t **nodes; // Root children for depth first, the current level for breadth first
+    int64_t node_count;
+    atomic_int_fast64_t *next;
+    int64_t made;
+} tree_worker_t;
+
+static tree_node_t *tree_arena_alloc(tree_arena_t *arena, int64_t count) {
+    if(arena->used + count > TREE_SLAB_NODES) {
+        if(arena->slab + 1 == arena->slab_max) {
+            return(NULL);
+        }
+        arena->slab++;
+        arena->used = 0;
+    }
+    if(arena->slab == arena->slab_count) {
+        arena->slabs[arena->slab_count] = malloc(sizeof(**arena->slabs) * TREE_SLAB_NODES);
+        assert(arena->slabs[arena->slab_count] != NULL);
+        arena->slab_count++;
+    }
+    tree_node_t *nodes = &arena->slabs[arena->slab][arena->used];
+    arena->used += count;
+    return(nodes);
+}
+static void tree_node_init(tree_node_t *node, move_t move, tree_node_t *parent) {
+    node->move         = move;
+    node->parent       = parent;
+    node->children     = NULL;
+    node->child_count  = 0;
+    node->subtree_size = 1;
+    node->result       = c_e;
+    node->expanded     = false;
+}
+tree_t *tree_alloc(int64_t thread_count, int64_t nodes_per_thread) {
+    /*
+     * Every thread can use at most nodes_per_thread nodes (rounded up to whole slabs), which bounds the memory of the whole tree
+     */
+    assert(thread_count > 0 && thread_count <= TREE_THREADS_MAX);
+    assert(TREE_SLAB_NODES >= MAXM);
+    tree_t *tree = calloc(1, sizeof(*tree));
+    assert(tree != NULL);
+    tree->thread_count = thread_count;
+    tree->root_board = chess_board_alloc();
+    for(int64_t i = 0; i < thread_count; i++) {
+        tree->arenas[i].slab_max = (nodes_per_thread + TREE_SLAB_NODES - 1) / TREE_SLAB_NODES;
+        tree->arenas[i].slab_max = tree->arenas[i].slab_max > 0 ? tree->arenas[i].slab_max : 1;
+        tree->arenas[i].slabs = malloc(sizeof(*tree->arenas[i].slabs) * tree->arenas[i].slab_max);
+        assert(tree->arenas[i].slabs != NULL);
+        tree->boards[i] = chess_board_alloc();
+    }
+    tree_reset(tree, &tree->root_board);
+    return(tree);
+}
+void tree_free(tree_t *tree) {
+    // Only the slabs get freed, so this costs the same no matter how many nodes are in the tree
+    for(int64_t i = 0; i < tree->thread_count; i++) {
+        for(int64_t j = 0; j < tree->arenas[i].slab_count; j++) {
+            free(tree->arenas[i].slabs[j]);
+        }
+        free(tree->arenas[i].slabs);
+        free(tree->boards[i].square);
+        free(tree->boards[i].movelist);
+    }
+    free(tree->root_board.square);
+    free(tree->root_board.movelist);
+    free(tree);
+}
+void tree_reset(tree_t *tree, board_t *board) {
+    // O(1) in the amount of nodes, the slabs stay allocated for the next tree
+    for(int64_t i = 0; i < tree->thread_count; i++) {
+        tree->arenas[i].slab = 0;
+        tree->arenas[i].used = 0;
+    }
+    if(board != &tree->root_board) {
+        chess_board_copy(&tree->root_board, board);
+    }
+    tree->root = tree_arena_alloc(&tree->arenas[0], 1);
+    tree_node_init(tree->root, chess_move_alloc(), NULL);
+    atomic_store(&tree->truncated, false);
+}
+static bool tree_node_expand(tree_t *tree, tree_arena_t *arena, tree_node_t *node, board_t *board, move_t *temp) {
+    chess_board_legal_moves(board, temp, board->stm);
+    node->result = chess_board_result(board);
+    if(node->result != c_e) {
+        node->expanded = true;
+        return(true);
+    }
+    int64_t count = chess_movelist_count(board->movelist);
+    tree_node_t *children = tree_arena_alloc(arena, count);
+    if(children == NULL) {
+        atomic_store(&tree->truncated, true);
+        return(false);
+    }
+    for(int64_t i = 0; i < count; i++) {
+        tree_node_init(&children[i], board->movelist[i], node);
+    }
+    node->children = children;
+    node->child_count = count;
+    node->expanded = true;
+    return(true);
+}
+int64_t tree_count(tree_node_t *node) {
+    node->subtree_size = 1;
+    for(int64_t i = 0; i < node->child_count; i++) {
+        node->subtree_size += tree_count(&node->children[i]);
+    }
+    return(node->subtree_size);
+}
+static void tree_replay(board_t *board, tree_node_t *node) {
+    if(node->parent == NULL) {
+        return;
+    }
+    tree_replay(board, node->parent);
+    chess_make_move(board, &node->move);
+    board->stm = -board->stm;
+}
+static void tree_run(tree_t *tree, tree_worker_t *workers, void *(*work)(void *)) {
+    pthread_t threads[TREE_THREADS_MAX];
+    for(int64_t i = 1; i < tree->thread_count; i++) {
+        if(pthread_create(&threads[i], NULL, work, &workers[i]) != 0) {
+            fprintf(stderr, "ERROR: Could not start tree worker %ld\n", i);
+            exit(1);
+        }
+    }
+    work(&workers[0]);
+    for(int64_t i = 1; i < tree->thread_count; i++) {
+        pthread_join(threads[i], NULL);
+    }
+}
+static int64_t tree_expand_recursive(tree_worker_t *worker, tree_node_t *node, int64_t depth) {
+    tree_t *tree = worker->tree;
+    board_t *board = &tree->boards[worker->index];
+    int64_t made = 0;
+    if(depth == 0) {
+        return(0);
+    }
+    if(!node->expanded) {
+        if(!tree_node_expand(tree, &tree->arenas[worker->index], node, board, tree->temp[worker->index])) {
+            return(0);
+        }
+        made += node->child_count;
+    }
+    for(int64_t i = 0; i < node->child_count; i++) {
+        chess_make_move(board, &node->children[i].move);
+        board->stm = -board->stm;
+        made += tree_expand_recursive(worker, &node->children[i], depth - 1);
+        board->stm = -board->stm;
+        chess_undo_move(board, &node->children[i].move);
+    }
+    return(made);
+}
+static void *tree_depth_first_worker(void *argument) {
+    tree_worker_t *worker = argument;
+    tree_t *tree = worker->tree;
+    int64_t i;
+    while((i = atomic_fetch_add(worker->next, 1)) < worker->node_count) {
+        chess_board_copy(&tree->boards[worker->index], &tree->root_board);
+        tree_replay(&tree->boards[worker->index], worker->nodes[i]);
+        worker->made += tree_expand_recursive(worker, worker->nodes[i], worker->depth);
+    }
+    return(NULL);
+}
+static void *tree_breadth_first_worker(void *argument) {
+    tree_worker_t *worker = argument;
+    tree_t *tree = worker->tree;
+    int64_t i;
+    while((i = atomic_fetch_add(worker->next, 1)) < worker->node_count) {
+        if(worker->nodes[i]->expanded) {
+            continue;
+        }
+        chess_board_copy(&tree->boards[worker->index], &tree->root_board);
+        tree_replay(&tree->boards[worker->index], worker->nodes[i]);
+        if(tree_node_expand(tree, &tree->arenas[worker->index], worker->nodes[i], &tree->boards[worker->index], tree->temp[worker->index])) {
+            worker->made += worker->nodes[i]->child_count;
+        }
+    }
+    return(NULL);
+}
+int64_t tree_expand_depth_first(tree_t *tree, int64_t depth) {
+    /*
+     * Expands every node up to depth plies below the root that isn't expanded yet and returns the amount of new nodes.
+     * The root gets expanded by the calling thread, after that the threads take the subtrees of the root children one at a time
+     */
+    tree_worker_t workers[TREE_THREADS_MAX];
+    atomic_int_fast64_t next = 0;
+    int64_t made = 0;
+    if(depth > 0 && !tree->root->expanded) {
+        chess_board_copy(&tree->boards[0], &tree->root_board);
+        if(tree_node_expand(tree, &tree->arenas[0], tree->root, &tree->boards[0], tree->temp[0])) {
+            made += tree->root->child_count;
+        }
+    }
+    tree_node_t **children = malloc(sizeof(*children) * (tree->root->child_count + 1));
+    assert(children != NULL);
+    for(int64_t i = 0; i < tree->root->child_count; i++) {
+        children[i] = &tree->root->children[i];
+    }
+    for(int64_t i = 0; i < tree->thread_count; i++) {
+        workers[i] = (tree_worker_t) {
+            .tree = tree, .index = i, .depth = depth - 1, .nodes = children, .node_count = tree->root->child_count, .next = &next, .made = 0,
+        };
+    }
+    if(depth > 1) {
+        tree_run(tree, workers, tree_depth_first_worker);
+    }
+    for(int64_t i = 0; i < tree->thread_count; i++) {
+        made += workers[i].made;
+    }
+    free(children);
+    tree_count(tree->root);
+    return(made);
+}
+int64_t tree_expand_breadth_first(tree_t *tree, int64_t depth) {
+    /*
+     * Same result as the depth first builder, but the tree grows one complete level at a time, so if the arenas run out it is the deepest level that is incomplete.
+     * Each level is split between the threads node by node
+     */
+    tree_worker_t workers[TREE_THREADS_MAX];
+    int64_t made = 0;
+    int64_t level_count = 1;
+    tree_node_t **level = malloc(sizeof(*level));
+    assert(level != NULL);
+    level[0] = tree->root;
+    for(int64_t d = 0; d < depth && level_count > 0; d++) {
+        atomic_int_fast64_t next = 0;
+        for(int64_t i = 0; i < tree->thread_count; i++) {
+            workers[i] = (tree_worker_t) {
+                .tree = tree, .index = i, .depth = 1, .nodes = level, .node_count = level_count, .next = &next, .made = 0,
+            };
+        }
+        tree_run(tree, workers, tree_breadth_first_worker);
+        int64_t next_count = 0;
+        for(int64_t i = 0; i < tree->thread_count; i++) {
+            made += workers[i].made;
+        }
+        for(int64_t i = 0; i < level_count; i++) {
+            next_count += level[i]->child_count;
+        }
+        tree_node_t **next_level = malloc(sizeof(*next_level) * (next_count + 1));
+        assert(next_level != NULL);
+        next_count = 0;
+        for(int64_t i = 0; i < level_count; i++) {
+            for(int64_t j = 0; j < level[i]->child_count; j++) {
+                next_level[next_count++] = &level[i]->children[j];
+            }
+        }
+        free(level);
+        level = next_level;
+        level_count = next_count;
+    }
+    free(level);
+    tree_count(tree->root);
+    return(made);
+}
+void tree_reroot(tree_t *tree, tree_node_t *node) {
+    /*
+     * Makes node the new root and keeps its subtree. The subtree gets copied out in breadth first order, all arenas are reset and it is copied back
+     * into arenas[0], so afterwards it is compact and the rest of the old tree is gone. If arenas[0] is too small the deepest levels are cut off.
+     */
+    int64_t count = tree_count(node);
+    tree_node_t *copy = malloc(sizeof(*copy) * count);
+    tree_node_t **where = malloc(sizeof(*where) * count);
+    int64_t *first_child = malloc(sizeof(*first_child) * count);
+    assert(copy != NULL && where != NULL && first_child != NULL);
+    copy[0] = *node;
+    int64_t next = 1;
+    for(int64_t i = 0; i < count; i++) {
+        first_child[i] = next;
+        for(int64_t j = 0; j < copy[i].child_count; j++) {
+            copy[next++] = copy[i].children[j];
+        }
+    }
+    // The root board has to follow along before the moves are gone
+    tree_replay(&tree->root_board, node);
+    tree_reset(tree, &tree->root_board);
+    *tree->root = copy[0];
+    tree->root->parent = NULL;
+    tree->root->move = chess_move_alloc();
+    where[0] = tree->root;
+    for(int64_t i = 1; i < count; i++) {
+        where[i] = NULL;
+    }
+    for(int64_t i = 0; i < count; i++) {
+        if(where[i] == NULL || copy[i].child_count == 0) {
+            continue;
+        }
+        tree_node_t *children = tree_arena_alloc(&tree->arenas[0], copy[i].child_count);
+        if(children == NULL) {
+            where[i]->children = NULL;
+            where[i]->child_count = 0;
+            where[i]->expanded = false;
+            atomic_store(&tree->truncated, true);
+            continue;
+        }
+        for(int64_t j = 0; j < copy[i].child_count; j++) {
+            children[j] = copy[first_child[i] + j];
+            children[j].parent = where[i];
+            where[first_child[i] + j] = &children[j];
+        }
+        where[i]->children = children;
+    }
+    free(copy);
+    free(where);
+    free(first_child);
+    tree_count(tree->root);
+}
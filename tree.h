@@ -0,0 +1,50 @@
+#ifndef TREE_H
+#define TREE_H
+
+#include "chess.h"
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#define TREE_THREADS_MAX 64
+#define TREE_SLAB_NODES 4096 // Has to be at least MAXM so that every childlist fits into one slab
+
+typedef struct tree_node {
+    move_t move; // The move that leads from the parent to this node
+    struct tree_node *parent;
+    struct tree_node *children; // All children of a node are contiguous in one slab
+    int64_t child_count;
+    int64_t subtree_size; // This node plus everything below it, updated by the builders
+    enum color result; // c_e unless the game is over in this position
+    bool expanded;
+} tree_node_t;
+
+typedef struct {
+    // Nodes are bump allocated out of fixed size slabs. Slabs are only malloced the first time they are needed and kept across resets
+    tree_node_t **slabs;
+    int64_t slab_count;
+    int64_t slab_max;
+    int64_t slab;
+    int64_t used;
+} tree_arena_t;
+
+typedef struct {
+    board_t root_board;
+    tree_node_t *root;
+    int64_t thread_count;
+    tree_arena_t arenas[TREE_THREADS_MAX]; // One per thread so that building needs no locks, the root always lives in arenas[0]
+    board_t boards[TREE_THREADS_MAX];
+    move_t temp[TREE_THREADS_MAX][MAXM];
+    atomic_bool truncated; // Set when an arena ran out of slabs and some nodes could not be expanded
+} tree_t;
+
+extern tree_t *tree_alloc(int64_t thread_count, int64_t nodes_per_thread);
+extern void tree_free(tree_t *tree);
+extern void tree_reset(tree_t *tree, board_t *board);
+extern int64_t tree_expand_depth_first(tree_t *tree, int64_t depth);
+extern int64_t tree_expand_breadth_first(tree_t *tree, int64_t depth);
+extern void tree_reroot(tree_t *tree, tree_node_t *node);
+extern int64_t tree_count(tree_node_t *node);
+
+#endif
@@ -0,0 +1,272 @@
+#include "uci.h"
+#include "chess.h"
+#include "mcts.h"
+#include <assert.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+int64_t uci_now(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return(now.tv_sec * 1000 + now.tv_nsec / 1000000);
+}
+uci_time_t uci_time_allocate(uci_limits_t *limits, enum color stm, int64_t move_overhead) {
+    uci_time_t time = {
+        .start = uci_now(),
+        .optimum = INT64_MAX,
+        .maximum = INT64_MAX,
+    };
+    if(limits->move_time > 0) {
+        time.optimum = limits->move_time > move_overhead ? limits->move_time - move_overhead : 1;
+        time.maximum = time.optimum;
+        return(time);
+    }
+    if(limits->infinite) {
+        return(time);
+    }
+    int64_t remaining = limits->time[CHESS_COLOR_INDEX(stm)];
+    int64_t increment = limits->increment[CHESS_COLOR_INDEX(stm)];
+    if(remaining <= 0) {
+        /*
+         * No usable clock for the side to move, e.g. go depth 5, go btime 60000 with white to move or go wtime 0.
+         * A node limit bounds the search on its own, otherwise it gets a fixed move time so that bestmove always comes without a stop
+         */
+        if(limits->nodes > 0) {
+            return(time);
+        }
+        time.optimum = UCI_MOVE_TIME_DEFAULT > move_overhead ? UCI_MOVE_TIME_DEFAULT - move_overhead : 1;
+        time.maximum = time.optimum;
+        return(time);
+    }
+    /*
+     * Spend an even share of the clock over the moves that are still to come plus most of the increment, since that comes back after the move anyway.
+     * The hard limit allows overshooting that a few times when the search is unsure, but never more than a third of the clock unless this is the last move before the time control.
+     * Both are capped by the clock minus the move overhead so that we can't lose on time
+     */
+    int64_t moves_to_go = limits->moves_to_go > 0 ? limits->moves_to_go : UCI_MOVES_TO_GO;
+    int64_t safe = remaining > move_overhead ? remaining - move_overhead : 1;
+    time.optimum = remaining / moves_to_go + increment * 3 / 4;
+    time.optimum = time.optimum < safe ? time.optimum : safe;
+    time.maximum = time.optimum * 4;
+    if(moves_to_go > 1 && time.maximum > safe / 3) {
+        time.maximum = safe / 3 > time.optimum ? safe / 3 : time.optimum;
+    }
+    time.maximum = time.maximum < safe ? time.maximum : safe;
+    return(time);
+}
+bool uci_search_should_stop(uci_search_t *search) {
+    /*
+     * Polled by every worker between every ply of every playout, so that both stop and the hard time limit are noticed well within a millisecond.
+     * Past the soft limit the search only goes on while the best root move is still contested
+     */
+    if(atomic_load_explicit(&search->stop, memory_order_relaxed)) {
+        return(true);
+    }
+    int64_t elapsed = uci_now() - search->time.start;
+    if(elapsed >= search->time.maximum) {
+        return(true);
+    }
+    return(elapsed >= search->time.optimum && mcts_is_decided(search->mcts));
+}
+static bool uci_mcts_stop(void *context) {
+    return(uci_search_should_stop(context));
+}
+static void *uci_search_thread(void *argument) {
+    uci_search_t *search = argument;
+    char name[6];
+    mcts_set_root(search->mcts, &search->board);
+    move_t best = mcts_search(search->mcts, search->limits.nodes, uci_mcts_stop, search);
+    // In infinite mode the GUI expects bestmove only after it sent stop, even if the search ended earlier
+    while(search->limits.infinite && !atomic_load(&search->stop)) {
+        nanosleep(&(struct timespec) {.tv_sec = 0, .tv_nsec = 100000}, NULL);
+    }
+    int64_t nodes = 0;
+    for(int64_t i = 0; i < search->mcts->thread_count; i++) {
+        nodes += search->mcts->workers[i].playouts;
+    }
+    int64_t elapsed = uci_now() - search->time.start;
+    printf("info nodes %ld time %ld nps %ld\n", nodes, elapsed, nodes * 1000 / (elapsed > 0 ? elapsed : 1));
+    if(chess_move_is_empty(&best)) {
+        printf("bestmove 0000\n");
+    } else {
+        chess_move_name(best, name);
+        printf("bestmove %s\n", name);
+    }
+    fflush(stdout);
+    return(NULL);
+}
+void uci_search_start(uci_search_t *search) {
+    uci_search_stop(search);
+    atomic_store(&search->stop, false);
+    search->time = uci_time_allocate(&search->limits, search->board.stm, search->move_overhead);
+    if(pthread_create(&search->thread, NULL, uci_search_thread, search) != 0) {
+        fprintf(stderr, "ERROR: Could not start the search thread\n");
+        exit(1);
+    }
+    search->searching = true;
+}
+void uci_search_stop(uci_search_t *search) {
+    if(!search->searching) {
+        return;
+    }
+    atomic_store(&search->stop, true);
+    pthread_join(search->thread, NULL);
+    search->searching = false;
+}
+static void uci_position(uci_search_t *search, char *arguments) {
+    char fen[UCI_LINE_MAX] = UCI_STARTPOS;
+    char *moves = strstr(arguments, "moves");
+    if(moves != NULL) {
+        *moves = '\0';
+        moves += strlen("moves");
+    }
+    if(strncmp(arguments, "fen", 3) == 0) {
+        // b_read_fen needs all six fields, but GUIs sometimes leave out the move counters
+        int64_t fields = 0;
+        char *token = strtok(arguments + 3, " \t");
+        fen[0] = '\0';
+        while(token != NULL) {
+            strcat(fen, fields == 0 ? "" : " ");
+            strcat(fen, token);
+            fields++;
+            token = strtok(NULL, " \t");
+        }
+        if(fields == 4) {
+            strcat(fen, " 0 1");
+        } else if(fields != 6) {
+            printf("info string invalid fen\n");
+            fflush(stdout);
+            return;
+        }
+    }
+    chess_board_read_fen(&search->board, fen);
+    if(moves == NULL) {
+        return;
+    }
+    char name[6];
+    for(char *token = strtok(moves, " \t"); token != NULL; token = strtok(NULL, " \t")) {
+        chess_board_legal_moves(&search->board, search->temp, search->board.stm);
+        int64_t count = chess_movelist_count(search->board.movelist);
+        int64_t i = 0;
+        while(i < count) {
+            chess_move_name(search->board.movelist[i], name);
+            if(strcmp(name, token) == 0) {
+                break;
+            }
+            i++;
+        }
+        if(i == count) {
+            // Castling and en passant are not generated yet, so a GUI sending them lands here too
+            printf("info string illegal move %s\n", token);
+            fflush(stdout);
+            return;
+        }
+        chess_make_move(&search->board, &search->board.movelist[i]);
+        search->board.stm = -search->board.stm;
+    }
+}
+static void uci_go(uci_search_t *search, char *arguments) {
+    uci_limits_t limits = {0};
+    bool limited = false;
+    for(char *token = strtok(arguments, " \t"); token != NULL; token = strtok(NULL, " \t")) {
+        if(strcmp(token, "infinite") == 0) {
+            limits.infinite = true;
+            continue;
+        }
+        char *value = strtok(NULL, " \t");
+        if(value == NULL) {
+            break;
+        }
+        if(strcmp(token, "wtime") == 0) {
+            limits.time[CHESS_COLOR_INDEX(c_w)] = atol(value);
+        } else if(strcmp(token, "btime") == 0) {
+            limits.time[CHESS_COLOR_INDEX(c_b)] = atol(value);
+        } else if(strcmp(token, "winc") == 0) {
+            limits.increment[CHESS_COLOR_INDEX(c_w)] = atol(value);
+        } else if(strcmp(token, "binc") == 0) {
+            limits.increment[CHESS_COLOR_INDEX(c_b)] = atol(value);
+        } else if(strcmp(token, "movestogo") == 0) {
+            limits.moves_to_go = atol(value);
+        } else if(strcmp(token, "movetime") == 0) {
+            limits.move_time = atol(value);
+        } else if(strcmp(token, "nodes") == 0) {
+            limits.nodes = atol(value);
+        }
+        limited = true;
+    }
+    // A bare go is treated like go infinite
+    limits.infinite |= !limited;
+    // The previous search thread reads search->limits until it is joined
+    uci_search_stop(search);
+    search->limits = limits;
+    uci_search_start(search);
+}
+static void uci_setoption(uci_search_t *search, char *arguments) {
+    char *name = strstr(arguments, "name");
+    char *value = strstr(arguments, "value");
+    if(name == NULL || value == NULL) {
+        return;
+    }
+    if(strstr(name, "Move Overhead") != NULL) {
+        search->move_overhead = atol(value + strlen("value"));
+        search->move_overhead = search->move_overhead < 0 ? 0 : search->move_overhead;
+    } else if(strstr(name, "Threads") != NULL) {
+        int64_t threads = atol(value + strlen("value"));
+        threads = threads < 1 ? 1 : (threads > MCTS_THREADS_MAX ? MCTS_THREADS_MAX : threads);
+        uci_search_stop(search);
+        mcts_free(search->mcts);
+        search->mcts = mcts_alloc(MCTS_NODES_DEFAULT, threads, mcts_evaluate_playout, NULL);
+    }
+}
+void uci_loop(void) {
+    char line[UCI_LINE_MAX];
+    uci_search_t *search = calloc(1, sizeof(*search));
+    assert(search != NULL);
+    search->board = chess_board_alloc();
+    search->move_overhead = UCI_MOVE_OVERHEAD;
+    search->mcts = mcts_alloc(MCTS_NODES_DEFAULT, 1, mcts_evaluate_playout, NULL);
+    chess_board_read_fen(&search->board, UCI_STARTPOS);
+    while(fgets(line, sizeof(line), stdin) != NULL) {
+        line[strcspn(line, "\r\n")] = '\0';
+        char *arguments = line + strcspn(line, " \t");
+        if(*arguments != '\0') {
+            *arguments = '\0';
+            arguments++;
+        }
+        if(strcmp(line, "uci") == 0) {
+            printf("id name Blade\n");
+            printf("id author DatoXx8\n");
+            printf("option name Move Overhead type spin default %d min 0 max 5000\n", UCI_MOVE_OVERHEAD);
+            printf("option name Threads type spin default 1 min 1 max %d\n", MCTS_THREADS_MAX);
+            printf("uciok\n");
+        } else if(strcmp(line, "isready") == 0) {
+            printf("readyok\n");
+        } else if(strcmp(line, "ucinewgame") == 0) {
+            uci_search_stop(search);
+            chess_board_read_fen(&search->board, UCI_STARTPOS);
+        } else if(strcmp(line, "position") == 0) {
+            uci_search_stop(search);
+            uci_position(search, arguments);
+        } else if(strcmp(line, "go") == 0) {
+            uci_go(search, arguments);
+        } else if(strcmp(line, "stop") == 0) {
+            uci_search_stop(search);
+        } else if(strcmp(line, "setoption") == 0) {
+            uci_setoption(search, arguments);
+        } else if(strcmp(line, "quit") == 0) {
+            break;
+        }
+        fflush(stdout);
+    }
+    uci_search_stop(search);
+    free(search->board.square);
+    free(search->board.movelist);
+    mcts_free(search->mcts);
+    free(search);
+}
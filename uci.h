@@ -0,0 +1,52 @@
+#ifndef UCI_H
+#define UCI_H
+
+#include "chess.h"
+#include "mcts.h"
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#define UCI_LINE_MAX 8192
+#define UCI_STARTPOS CHESS_STARTPOS
+#define UCI_MOVES_TO_GO 30 // Assumed amount of remaining moves when the GUI doesn't send movestogo
+#define UCI_MOVE_OVERHEAD 10 // Default for the Move Overhead option in ms
+#define UCI_MOVE_TIME_DEFAULT 1000 // Move time in ms for a go that has neither a clock for the side to move nor a node limit, e.g. go depth
+
+typedef struct {
+    int64_t time[2]; // Remaining clock in ms, indexed by CHESS_COLOR_INDEX
+    int64_t increment[2];
+    int64_t moves_to_go;
+    int64_t move_time;
+    int64_t nodes;
+    bool infinite;
+} uci_limits_t;
+
+typedef struct {
+    // All in ms on the uci_now clock. After optimum the search stops as soon as the best move is clear, at maximum unconditionally
+    int64_t start;
+    int64_t optimum;
+    int64_t maximum;
+} uci_time_t;
+
+typedef struct {
+    board_t board;
+    move_t temp[MAXM];
+    mcts_t *mcts;
+    uci_limits_t limits;
+    uci_time_t time;
+    atomic_bool stop;
+    bool searching;
+    pthread_t thread;
+    int64_t move_overhead;
+} uci_search_t;
+
+extern int64_t uci_now(void);
+extern uci_time_t uci_time_allocate(uci_limits_t *limits, enum color stm, int64_t move_overhead);
+extern bool uci_search_should_stop(uci_search_t *search);
+extern void uci_search_start(uci_search_t *search);
+extern void uci_search_stop(uci_search_t *search);
+extern void uci_loop(void);
+
+#endif